@@ -0,0 +1,513 @@
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CachePruning.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
+#ifdef SR_HAVE_CLANG
+#include "clang/CodeGen/CodeGenAction.h"
+#include "clang/Driver/Driver.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/CompilerInvocation.h"
+#include "clang/Frontend/TextDiagnosticPrinter.h"
+#include "clang/Frontend/Utils.h"
+#endif
+using namespace llvm;
+
+// sr-driver runs the strength reduction pipeline over whole modules on a
+// thread pool: each module is split into parts by function, every part
+// is optimized by a worker in an LLVMContext of its own, and the parts
+// are linked back and written out as opt_<name>.ll, .bc and/or .o
+// built with clang, it also takes C sources, which go from source to
+// object in one worker without ever leaving memory
+// with a -cache-dir, the optimized bitcode and objects are kept there
+// under a hash of the input's IR, the options and the pass, and an input
+// seen before skips the pipeline and code generation
+
+static cl::list<std::string> InputFiles(
+    cl::Positional, cl::OneOrMore,
+    cl::desc("<input .ll/.bc files, and .c files when built with clang>"));
+
+static cl::opt<std::string> Passes(
+    "passes", cl::init("mem2reg,loop(sr),dce"),
+    cl::desc("Function pipeline to run over every part"));
+
+static cl::opt<std::string> OutputDir(
+    "o", cl::init("."), cl::value_desc("dir"),
+    cl::desc("Directory for the opt_<name> outputs"));
+
+enum OutputKind { EmitLL, EmitBC, EmitObj };
+
+static cl::list<OutputKind> Emit(
+    "emit", cl::CommaSeparated,
+    cl::desc("Outputs to write for every input (default: ll,bc)"),
+    cl::values(clEnumValN(EmitLL, "ll", "opt_<name>.ll"),
+               clEnumValN(EmitBC, "bc", "opt_<name>.bc"),
+               clEnumValN(EmitObj, "obj", "opt_<name>.o, for the module's target")));
+
+static cl::opt<unsigned> Jobs(
+    "j", cl::init(0), cl::Prefix,
+    cl::desc("Number of worker threads (0 = one per hardware thread)"));
+
+// only here for -help; main() looks for it before the options are
+// parsed, so that the options of the plugin parse too
+static cl::opt<std::string> PluginPath(
+    "plugin", cl::init(SR_PLUGIN_PATH), cl::value_desc("path"),
+    cl::desc("Pass plugin that provides the pipeline's passes"));
+
+static cl::opt<std::string> CacheDir(
+    "cache-dir", cl::value_desc("dir"),
+    cl::desc("Reuse the outputs of inputs optimized before, kept in dir"));
+
+static cl::opt<std::string> CachePolicy(
+    "cache-policy", cl::value_desc("policy"),
+    cl::desc("How to prune the -cache-dir, in ThinLTO's syntax, e.g. "
+             "cache_size_bytes=1g:prune_after=24h"));
+
+#ifdef SR_HAVE_CLANG
+static cl::list<std::string> CFlags(
+    "cflags", cl::CommaSeparated, cl::value_desc("flags"),
+    cl::desc("clang flags for the C inputs, e.g. -cflags=-O1,-Isupport,-DN=1"));
+#endif
+
+// one input on its way through the driver; the context is only for the
+// result, so that its types get their names back when the parts are linked
+struct Input {
+  std::string Name;
+  std::string ModuleID;
+  // the input's key in the -cache-dir, if there is one
+  std::string Key;
+  bool IsC = false;
+  LLVMContext Ctx;
+  // the parts as bitcode, before and after the pipeline
+  std::vector<SmallVector<char, 0>> Parts;
+  std::vector<SmallVector<char, 0>> Results;
+  // what went wrong in each task, printed once they are all done: one
+  // per part and one for linking and writing, or just one for a C input
+  std::vector<std::string> Errors;
+};
+
+static Error makeError(const Twine &Msg) {
+  return make_error<StringError>(Msg, inconvertibleErrorCode());
+}
+
+static SmallVector<char, 0> writeBitcode(const Module &M) {
+  SmallVector<char, 0> Buffer;
+  raw_svector_ostream OS(Buffer);
+  WriteBitcodeToFile(M, OS);
+  return Buffer;
+}
+
+// the hash of everything but the input that decides what the driver
+// makes of it, set up by main()
+static std::string CacheConfig;
+
+static void hashFile(SHA1 &Hash, StringRef Path) {
+  if (auto Buffer = MemoryBuffer::getFile(Path))
+    Hash.update((*Buffer)->getBuffer());
+  else
+    Hash.update(Path);
+}
+
+// the key of a module's outputs in the cache; the IR is what clang made
+// of a C input, so changed headers and flags are covered too
+static std::string cacheKey(const SmallVector<char, 0> &Bitcode) {
+  SHA1 Hash;
+  Hash.update(CacheConfig);
+  Hash.update(StringRef(Bitcode.data(), Bitcode.size()));
+  return toHex(Hash.final());
+}
+
+// pruneCache only removes files with the llvmcache- prefix
+static std::string cachePath(StringRef Key, StringRef Ext) {
+  SmallString<128> Path(CacheDir);
+  sys::path::append(Path, "llvmcache-" + Key + Ext);
+  return std::string(Path);
+}
+
+static std::unique_ptr<MemoryBuffer> cacheLookup(StringRef Key, StringRef Ext) {
+  if (Key.empty()) return nullptr;
+  auto Buffer = MemoryBuffer::getFile(cachePath(Key, Ext));
+  return Buffer ? std::move(*Buffer) : nullptr;
+}
+
+// the cache is only a shortcut, so failing to fill it is no error; the
+// rename keeps other drivers from reading half written entries
+static void cacheStore(StringRef Key, StringRef Ext, StringRef Data) {
+  if (Key.empty()) return;
+  std::string Path = cachePath(Key, Ext);
+  consumeError(writeFileAtomically(Path + ".tmp%%%%%%", Path, Data));
+}
+
+// a target machine for the triple, or none if there is no such target;
+// position independent, like the objects of the host compiler
+static std::unique_ptr<TargetMachine> createTargetMachine(const std::string &TT) {
+  std::string Msg;
+  const Target* T = TT.empty() ? nullptr : TargetRegistry::lookupTarget(TT, Msg);
+  if (!T) return nullptr;
+  return std::unique_ptr<TargetMachine>(
+      T->createTargetMachine(TT, "", "", TargetOptions(), Reloc::PIC_));
+}
+
+// run the pipeline over M, with a target machine of its own
+static Error runPipeline(Module &M, const PassPlugin &Plugin) {
+  // like opt, optimize for the target the module names, if it has one
+  std::unique_ptr<TargetMachine> TM = createTargetMachine(M.getTargetTriple());
+
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+  PassBuilder PB(TM.get());
+  Plugin.registerPassBuilderCallbacks(PB);
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+  ModulePassManager MPM;
+  if (Error Err = PB.parsePassPipeline(MPM, Passes)) return Err;
+  MPM.run(M, MAM);
+  return Error::success();
+}
+
+// run the pipeline over one part, in a context of its own, and return
+// the result as bitcode
+static Expected<SmallVector<char, 0>> runPart(const SmallVector<char, 0> &Part,
+                                              const PassPlugin &Plugin) {
+  LLVMContext Ctx;
+  auto M = parseBitcodeFile(MemoryBufferRef(StringRef(Part.data(), Part.size()),
+                                            "part"), Ctx);
+  if (!M) return M.takeError();
+  if (Error Err = runPipeline(**M, Plugin)) return Err;
+  return writeBitcode(**M);
+}
+
+// link the optimized parts of In back into one module
+static Expected<std::unique_ptr<Module>> linkParts(Input &In) {
+  std::unique_ptr<Module> Merged;
+  for (const SmallVector<char, 0> &Result : In.Results) {
+    auto Part = parseBitcodeFile(
+        MemoryBufferRef(StringRef(Result.data(), Result.size()), In.Name), In.Ctx);
+    if (!Part) return Part.takeError();
+    if (!Merged) {
+      Merged = std::move(*Part);
+      continue;
+    }
+    if (Linker::linkModules(*Merged, std::move(*Part)))
+      return makeError("cannot link the parts back");
+  }
+  // every part carries a copy of the named metadata, like llvm.ident
+  for (NamedMDNode &NMD : Merged->named_metadata()) {
+    SmallVector<MDNode*, 4> Ops;
+    SmallPtrSet<MDNode*, 4> Seen;
+    for (MDNode* Op : NMD.operands())
+      if (Seen.insert(Op).second) Ops.push_back(Op);
+    NMD.clearOperands();
+    for (MDNode* Op : Ops) NMD.addOperand(Op);
+  }
+  Merged->setModuleIdentifier(In.ModuleID);
+  return Merged;
+}
+
+// emit M as an object for the target it names, or for the host if it
+// names none, straight from memory like llc does
+static Error emitObject(Module &M, raw_pwrite_stream &OS) {
+  if (M.getTargetTriple().empty())
+    M.setTargetTriple(sys::getDefaultTargetTriple());
+  std::unique_ptr<TargetMachine> TM = createTargetMachine(M.getTargetTriple());
+  if (!TM) return makeError("no target for " + M.getTargetTriple());
+  if (M.getDataLayout().isDefault())
+    M.setDataLayout(TM->createDataLayout());
+
+  legacy::PassManager PM;
+  if (TM->addPassesToEmitFile(PM, OS, nullptr, CGFT_ObjectFile))
+    return makeError("cannot emit objects for " + M.getTargetTriple());
+  PM.run(M);
+  return Error::success();
+}
+
+// verify M and write the outputs -emit asks for, the object last since
+// code generation changes the module; with a Key, the bitcode and object
+// come from the cache when it has them and go into it when it has not
+static Error writeOutputs(Module &M, StringRef Name, StringRef Key) {
+  std::string Broken;
+  raw_string_ostream BrokenOS(Broken);
+  if (verifyModule(M, &BrokenOS)) return makeError(BrokenOS.str());
+
+  StringRef Stem = sys::path::stem(Name);
+  for (OutputKind Kind : {EmitLL, EmitBC, EmitObj}) {
+    // the cache always gets the bitcode, to make the other outputs from
+    bool Wanted = is_contained(Emit, Kind);
+    if (!Wanted && (Kind != EmitBC || Key.empty())) continue;
+    StringRef Ext = Kind == EmitLL ? ".ll" : Kind == EmitBC ? ".bc" : ".o";
+
+    std::unique_ptr<MemoryBuffer> Hit;
+    if (Kind != EmitLL) Hit = cacheLookup(Key, Ext);
+    SmallVector<char, 0> Buffer;
+    if (!Hit) {
+      raw_svector_ostream OS(Buffer);
+      if (Kind == EmitLL)
+        M.print(OS, nullptr);
+      else if (Kind == EmitBC)
+        WriteBitcodeToFile(M, OS);
+      else if (Error Err = emitObject(M, OS))
+        return Err;
+      if (Kind != EmitLL) cacheStore(Key, Ext, OS.str());
+    }
+    if (!Wanted) continue;
+
+    SmallString<128> Path(OutputDir);
+    sys::path::append(Path, "opt_" + Stem + Ext);
+    std::error_code EC;
+    ToolOutputFile Out(Path, EC, Kind == EmitLL ? sys::fs::OF_Text : sys::fs::OF_None);
+    if (EC) return makeError(Path + ": " + EC.message());
+    Out.os() << (Hit ? Hit->getBuffer() : StringRef(Buffer.data(), Buffer.size()));
+    Out.keep();
+  }
+  return Error::success();
+}
+
+// compile a C input to IR, run the pipeline and write it out, all in the
+// worker's own context; clang only optimizes what the -cflags ask it to
+static Error compileC([[maybe_unused]] const Input &In,
+                       [[maybe_unused]] const PassPlugin &Plugin) {
+#ifdef SR_HAVE_CLANG
+  std::string Log;
+  raw_string_ostream LogOS(Log);
+  IntrusiveRefCntPtr<clang::DiagnosticOptions> DiagOpts = new clang::DiagnosticOptions;
+  IntrusiveRefCntPtr<clang::DiagnosticsEngine> Diags =
+      clang::CompilerInstance::createDiagnostics(
+          DiagOpts.get(), new clang::TextDiagnosticPrinter(LogOS, DiagOpts.get()));
+
+  // let clang's own driver find the system headers, in the resource
+  // directory it would use itself, which is named after the full version
+  // up to LLVM 15 and after the major one since; -O0 would make every
+  // function optnone and keep the pipeline out
+  std::string ResourceDir = clang::driver::Driver::GetResourcesPath(SR_CLANG_PATH);
+  SmallVector<const char*, 16> Args{"clang", "-c", "-resource-dir", ResourceDir.c_str(),
+                                    "-Xclang", "-disable-O0-optnone"};
+  for (const std::string &Flag : CFlags) Args.push_back(Flag.c_str());
+  Args.push_back(In.Name.c_str());
+  std::unique_ptr<clang::CompilerInvocation> Invocation =
+      clang::createInvocationFromCommandLine(Args, Diags);
+  if (!Invocation) return makeError(LogOS.str());
+
+  clang::CompilerInstance CI;
+  CI.setInvocation(std::move(Invocation));
+  CI.createDiagnostics(new clang::TextDiagnosticPrinter(LogOS, &CI.getDiagnosticOpts()));
+  LLVMContext Ctx;
+  clang::EmitLLVMOnlyAction Action(&Ctx);
+  if (!CI.ExecuteAction(Action)) return makeError(LogOS.str());
+  std::unique_ptr<Module> M = Action.takeModule();
+  if (CacheDir.empty()) {
+    if (Error Err = runPipeline(*M, Plugin)) return Err;
+    return writeOutputs(*M, In.Name, "");
+  }
+
+  // a fresh context for the cached module, or its types would be renamed
+  std::string Key = cacheKey(writeBitcode(*M));
+  std::unique_ptr<MemoryBuffer> Hit = cacheLookup(Key, ".bc");
+  if (!Hit) {
+    if (Error Err = runPipeline(*M, Plugin)) return Err;
+    return writeOutputs(*M, In.Name, Key);
+  }
+  LLVMContext HitCtx;
+  auto Cached = parseBitcodeFile(Hit->getMemBufferRef(), HitCtx);
+  if (!Cached) return Cached.takeError();
+  return writeOutputs(**Cached, In.Name, Key);
+#else
+  return makeError("sr-driver was built without clang, so it only takes IR");
+#endif
+}
+
+int main(int argc, char** argv) {
+  InitLLVM X(argc, argv);
+  InitializeAllTargetInfos();
+  InitializeAllTargets();
+  InitializeAllTargetMCs();
+  InitializeAllAsmPrinters();
+
+  std::string Path = SR_PLUGIN_PATH;
+  for (int i = 1; i < argc; ++i) {
+    StringRef Arg(argv[i]);
+    if (Arg.consume_front("-plugin=") || Arg.consume_front("--plugin="))
+      Path = Arg.str();
+  }
+  auto Plugin = PassPlugin::Load(Path);
+  if (!Plugin) {
+    WithColor::error() << toString(Plugin.takeError()) << "\n";
+    return 1;
+  }
+  cl::ParseCommandLineOptions(argc, argv, "parallel strength reduction driver\n");
+  if (Emit.empty()) {
+    Emit.push_back(EmitLL);
+    Emit.push_back(EmitBC);
+  }
+
+  // everything but the input that decides what comes out of it: LLVM, the
+  // driver and the pass, and the options, with the contents of the files
+  // they name, like -sr-profile=; not where the outputs go, or how fast
+  CachePruningPolicy Policy;
+  if (!CacheDir.empty()) {
+    auto Parsed = parseCachePruningPolicy(CachePolicy);
+    if (!Parsed) {
+      WithColor::error() << toString(Parsed.takeError()) << "\n";
+      return 1;
+    }
+    Policy = *Parsed;
+    if (std::error_code EC = sys::fs::create_directories(CacheDir)) {
+      WithColor::error() << CacheDir << ": " << EC.message() << "\n";
+      return 1;
+    }
+
+    SHA1 Hash;
+    Hash.update(LLVM_VERSION_STRING);
+    hashFile(Hash, sys::fs::getMainExecutable(argv[0], (void*)&makeError));
+    hashFile(Hash, Path);
+    for (int i = 1; i < argc; ++i) {
+      StringRef Arg(argv[i]);
+      StringRef Name = Arg.ltrim('-');
+      if (Name == "o") ++i;
+      if (Name == "o" || Name.startswith("o=") || Name.startswith("j") ||
+          Name.startswith("emit") || Name.startswith("cache-") ||
+          Name.startswith("plugin") || is_contained(InputFiles, Arg))
+        continue;
+      Hash.update(Arg);
+      Hash.update(StringRef("", 1));
+      StringRef Value = Arg.split('=').second;
+      if (!Value.empty() && sys::fs::is_regular_file(Value)) hashFile(Hash, Value);
+    }
+    CacheConfig = toHex(Hash.final());
+  }
+
+  // check the pipeline once here rather than in every worker
+  {
+    PassBuilder PB;
+    Plugin->registerPassBuilderCallbacks(PB);
+    ModulePassManager MPM;
+    if (Error Err = PB.parsePassPipeline(MPM, Passes)) {
+      WithColor::error() << toString(std::move(Err)) << "\n";
+      return 1;
+    }
+  }
+
+  ThreadPool Pool(hardware_concurrency(Jobs));
+  std::vector<std::unique_ptr<Input>> Inputs;
+  for (const std::string &Name : InputFiles) {
+    auto In = std::make_unique<Input>();
+    In->Name = Name;
+    if (sys::path::extension(Name) == ".c") {
+      In->IsC = true;
+      In->Errors.resize(1);
+      Inputs.push_back(std::move(In));
+      continue;
+    }
+
+    LLVMContext Ctx;
+    SMDiagnostic Err;
+    std::unique_ptr<Module> M = parseIRFile(Name, Err, Ctx);
+    if (!M) {
+      Err.print(argv[0], WithColor::error());
+      return 1;
+    }
+    In->ModuleID = M->getModuleIdentifier();
+
+    // a module the cache has seen skips the pipeline: the optimized
+    // bitcode from the cache is its one and only result
+    SmallVector<char, 0> Bitcode;
+    if (!CacheDir.empty()) {
+      Bitcode = writeBitcode(*M);
+      In->Key = cacheKey(Bitcode);
+      if (std::unique_ptr<MemoryBuffer> Hit = cacheLookup(In->Key, ".bc")) {
+        In->Results.emplace_back(Hit->getBufferStart(), Hit->getBufferEnd());
+        In->Errors.resize(1);
+        Inputs.push_back(std::move(In));
+        continue;
+      }
+    }
+
+    // no more parts than workers, or functions to put in them; locals
+    // stay in the part with their users, so nothing changes linkage
+    unsigned defined = count_if(*M, [](Function &F) { return !F.isDeclaration(); });
+    unsigned parts = std::max(1u, std::min(Pool.getThreadCount(), defined));
+    if (parts == 1)
+      In->Parts.push_back(Bitcode.empty() ? writeBitcode(*M) : std::move(Bitcode));
+    else
+      SplitModule(*M, parts, [&](std::unique_ptr<Module> Part) {
+        In->Parts.push_back(writeBitcode(*Part));
+      }, /*PreserveLocals=*/true);
+    In->Results.resize(In->Parts.size());
+    In->Errors.resize(In->Parts.size() + 1);
+    Inputs.push_back(std::move(In));
+  }
+
+  // the workers only touch their own part, result and error; a C input
+  // is a single task from source to outputs
+  for (auto &In : Inputs) {
+    if (In->IsC) {
+      Pool.async([&In, &Plugin]() {
+        if (Error Err = compileC(*In, *Plugin))
+          In->Errors[0] = toString(std::move(Err));
+      });
+      continue;
+    }
+    for (unsigned i = 0; i != In->Parts.size(); ++i)
+      Pool.async([&In, i, &Plugin]() {
+        auto Result = runPart(In->Parts[i], *Plugin);
+        if (Result)
+          In->Results[i] = std::move(*Result);
+        else
+          In->Errors[i] = toString(Result.takeError());
+      });
+  }
+  Pool.wait();
+
+  // every input has a context of its own, so the IR inputs are linked
+  // and written out, code generation and all, side by side too
+  for (auto &In : Inputs) {
+    if (In->IsC || any_of(In->Errors, [](const std::string &E) { return !E.empty(); }))
+      continue;
+    Pool.async([&In]() {
+      auto M = linkParts(*In);
+      Error Err = M ? writeOutputs(**M, In->Name, In->Key) : M.takeError();
+      if (Err) In->Errors.back() = toString(std::move(Err));
+    });
+  }
+  Pool.wait();
+
+  if (!CacheDir.empty()) pruneCache(CacheDir, Policy);
+
+  int status = 0;
+  for (auto &In : Inputs)
+    for (const std::string &E : In->Errors)
+      if (!E.empty()) {
+        WithColor::error() << In->Name << ": " << E << "\n";
+        status = 1;
+      }
+  return status;
+}
@@ -0,0 +1,90 @@
+// host speed harness for the embench benchmarks, linked in place of
+// support/main.c by speed_report.py
+// usage: <benchmark> [runs] [warm-ups] [cpu]
+// pins itself to the cpu (0 by default, -1 to leave it), calls benchmark()
+// for the warm-ups and then once per run, counting user space cycles and
+// instructions around each call with perf_event_open; prints one line
+//   <cycles> <instructions> <nanoseconds> <correct>
+// per run, with -1 for counters the kernel would not give us
+#define _GNU_SOURCE
+#include <linux/perf_event.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "support.h"
+
+static int open_counter(uint64_t config, int group) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.disabled = group == -1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP;
+  return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+// the cycles counter leads a group with the instructions one, so that
+// both are started, stopped and read together
+static int open_counters(void) {
+  int leader = open_counter(PERF_COUNT_HW_CPU_CYCLES, -1);
+  if (leader == -1)
+    perror("perf_event_open");
+  else
+    open_counter(PERF_COUNT_HW_INSTRUCTIONS, leader);
+  return leader;
+}
+
+static uint64_t now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[]) {
+  int runs = argc > 1 ? atoi(argv[1]) : 10;
+  int warmups = argc > 2 ? atoi(argv[2]) : 1;
+  int cpu = argc > 3 ? atoi(argv[3]) : 0;
+
+  if (cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set)) perror("sched_setaffinity");
+  }
+  int leader = open_counters();
+
+  initialise_benchmark();
+  for (int i = 0; i < warmups; ++i) benchmark();
+
+  for (int i = 0; i < runs; ++i) {
+    // the group read is the number of counters followed by their values
+    uint64_t values[3] = {0, 0, 0};
+    uint64_t start = now();
+    if (leader != -1) {
+      ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+      ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+    volatile int result = benchmark();
+    if (leader != -1) {
+      ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+      if (read(leader, values, sizeof(values)) == -1) values[0] = 0;
+    }
+    uint64_t elapsed = now() - start;
+
+    long long cycles = values[0] >= 1 ? (long long)values[1] : -1;
+    long long instructions = values[0] >= 2 ? (long long)values[2] : -1;
+    printf("%lld %lld %llu %d\n", cycles, instructions,
+           (unsigned long long)elapsed, verify_benchmark(result));
+  }
+  return 0;
+}
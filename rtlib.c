@@ -0,0 +1,142 @@
+// runtime for loops instrumented by the sr pass with -sr-instrument
+// every call only appends an event to a buffer; full buffers are folded
+// into a table with one record per loop, and at exit the table is written
+// to $SR_PROFILE (sr.prof by default) for srprof.py to read
+// the runtime keeps no locks, so profile single threaded runs
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the profile is a header followed by one record per loop, in the byte
+// order of the machine that ran the program
+struct sr_header {
+  char magic[4];  // "SRPF"
+  uint32_t version;
+  uint32_t loops;
+  uint32_t reserved;
+};
+
+#define SR_HAS_STRIDE 1
+
+struct sr_record {
+  uint32_t id;
+  uint32_t flags;       // SR_HAS_STRIDE once a stride was observed
+  uint64_t entries;     // times the loop was entered from its preheader
+  uint64_t iterations;  // times its header ran
+  uint64_t max_trip;    // most iterations between two entries
+  int64_t min_stride;
+  int64_t max_stride;
+};
+
+enum sr_kind { SR_ENTRY, SR_ITERATION, SR_STRIDE };
+
+struct sr_event {
+  uint32_t id;
+  uint32_t kind;
+  int64_t value;
+};
+
+// a table slot: the record and the iterations of the current trip
+struct sr_slot {
+  struct sr_record rec;
+  uint64_t trip;
+  int used;
+};
+
+#define SR_BUFFER_SIZE 4096
+
+static struct sr_event buffer[SR_BUFFER_SIZE];
+static unsigned buffered;
+static struct sr_slot *table;
+static unsigned capacity, loops;
+static int registered;
+
+// open addressing, the ids are hashes already
+static struct sr_slot *lookup(uint32_t id) {
+  if (4 * (loops + 1) > 3 * capacity) {
+    struct sr_slot *old = table;
+    unsigned old_capacity = capacity;
+    capacity = capacity ? 2 * capacity : 64;
+    table = calloc(capacity, sizeof(struct sr_slot));
+    if (!table) abort();
+    for (unsigned i = 0; i < old_capacity; ++i) {
+      if (!old[i].used) continue;
+      unsigned j = old[i].rec.id & (capacity - 1);
+      while (table[j].used) j = (j + 1) & (capacity - 1);
+      table[j] = old[i];
+    }
+    free(old);
+  }
+  unsigned i = id & (capacity - 1);
+  while (table[i].used && table[i].rec.id != id) i = (i + 1) & (capacity - 1);
+  if (!table[i].used) {
+    table[i].used = 1;
+    table[i].rec.id = id;
+    ++loops;
+  }
+  return &table[i];
+}
+
+static void end_trip(struct sr_slot *s) {
+  if (s->trip > s->rec.max_trip) s->rec.max_trip = s->trip;
+  s->trip = 0;
+}
+
+static void flush(void) {
+  for (unsigned i = 0; i < buffered; ++i) {
+    struct sr_event *e = &buffer[i];
+    struct sr_slot *s = lookup(e->id);
+    switch (e->kind) {
+    case SR_ENTRY:
+      end_trip(s);
+      ++s->rec.entries;
+      break;
+    case SR_ITERATION:
+      ++s->rec.iterations;
+      ++s->trip;
+      break;
+    case SR_STRIDE:
+      if (!(s->rec.flags & SR_HAS_STRIDE) || e->value < s->rec.min_stride)
+        s->rec.min_stride = e->value;
+      if (!(s->rec.flags & SR_HAS_STRIDE) || e->value > s->rec.max_stride)
+        s->rec.max_stride = e->value;
+      s->rec.flags |= SR_HAS_STRIDE;
+      break;
+    }
+  }
+  buffered = 0;
+}
+
+static void write_profile(void) {
+  flush();
+  const char *path = getenv("SR_PROFILE");
+  FILE *f = fopen(path ? path : "sr.prof", "wb");
+  if (!f) {
+    perror("sr.prof");
+    return;
+  }
+  struct sr_header h = {{'S', 'R', 'P', 'F'}, 1, loops, 0};
+  fwrite(&h, sizeof(h), 1, f);
+  for (unsigned i = 0; i < capacity; ++i) {
+    if (!table[i].used) continue;
+    end_trip(&table[i]);
+    fwrite(&table[i].rec, sizeof(struct sr_record), 1, f);
+  }
+  fclose(f);
+}
+
+static void record(uint32_t id, uint32_t kind, int64_t value) {
+  if (!registered) {
+    registered = 1;
+    atexit(write_profile);
+  }
+  if (buffered == SR_BUFFER_SIZE) flush();
+  buffer[buffered++] = (struct sr_event){id, kind, value};
+}
+
+void logentry(uint32_t id) { record(id, SR_ENTRY, 0); }
+
+void logop(uint32_t id) { record(id, SR_ITERATION, 0); }
+
+void logstride(uint32_t id, int64_t stride) { record(id, SR_STRIDE, stride); }
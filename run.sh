@@ -1,15 +1,26 @@
 set -x
 
-# setup env variable 
-export PATH="/work/zhang-x1/common/install/llvm-8.0/build/bin/":$PATH
-export LLVM_DIR=/work/zhang-x1/common/install/llvm-8.0/build/lib/cmake/llvm/
-export EMBENCH_DIR=/work/zhang-x1/users/yz882/cs6120/llvm-pass-skeleton/embench-iot/
-# compile pass to generate shared lib
-rm -rf build; mkdir build; cd build/; cmake ../; make; cd -
-# compile to llvm bitcode with clang fromtemd
+# setup env variable: LLVM 14 or later, the one llvm-config on PATH
+# belongs to unless LLVM_DIR says otherwise
+export LLVM_DIR=${LLVM_DIR:-$(llvm-config --cmakedir)}
+export PATH="$LLVM_DIR/../../../bin":$PATH
+export EMBENCH_DIR=${EMBENCH_DIR:-$PWD/embench-iot}
+# compile pass to generate shared lib, rebuilding only what changed
+cmake -S . -B build && cmake --build build
+# the driver reuses the outputs of benchmarks whose IR, options and pass
+# are the same as in an earlier run
+CACHE=${SR_CACHE_DIR:-.sr-cache}
 rm *.bc
 rm *.ll
 rm *.o
+PASSES='mem2reg,instsimplify,loop(indvars,sr),dce'
+if build/driver/sr-driver --help-hidden | grep -q -- -cflags; then
+  # the driver has clang built in: straight from C to opt_<name>.o, on
+  # every core, without writing any IR
+  build/driver/sr-driver -passes=$PASSES -emit=obj -cache-dir=$CACHE \
+    -cflags=-I$1,-I$EMBENCH_DIR/support,-DCPU_MHZ=1000 $1/*.c $EMBENCH_DIR/support/*.c
+else
+# compile to llvm bitcode with clang fromtemd
 clang -c -emit-llvm -O0 -Xclang -disable-O0-optnone $1/*.c $EMBENCH_DIR/support/*.c -I$1 \
 -I$EMBENCH_DIR/support -DCPU_MHZ=1000
 
@@ -19,13 +30,13 @@ do
   llvm-dis ${f} 
 done
 
-for f in *.ll
-do
-  # optimze with llvm opt
-  opt -S -load build/skeleton/libSkeletonPass.so -mem2reg -sr -dce ${f} -o opt_${f}
-  opt -S -load build/skeleton/libSkeletonPass.so -mem2reg -sr -dce ${f} -o opt_${f}.bc
-  llc -filetype=obj opt_${f}.bc; 
-done
+# optimize all the modules at once on every core, writing opt_<name>.ll
+# and the object opt_<name>.o for each
+build/driver/sr-driver -passes=$PASSES -emit=ll,obj -cache-dir=$CACHE *.ll
+fi
 
 gcc *.o -lm; 
-time ./a.out
+./a.out
+# time it against the same pipeline without sr: many pinned, warmed up
+# runs with cycle counters rather than a single time ./a.out
+./speed_report.py --build build $(basename $1)
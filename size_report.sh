@@ -0,0 +1,50 @@
+#!/bin/sh
+# compare the .text size of every embench benchmark at -Os, where the sr
+# pass runs in size mode, without and with the pass, against the sizes
+# in embench's baseline-data/size.json; fail if sr grows any benchmark
+# usage: size_report.sh [build dir] [extra clang flags]
+# e.g.   size_report.sh build --target=riscv32-unknown-elf -march=rv32imc
+
+BUILD=${1:-build}
+[ $# -gt 0 ] && shift
+PLUGIN=$BUILD/skeleton/libSkeletonPass.so
+EMBENCH_DIR=${EMBENCH_DIR:-embench-iot}
+TMP=$(mktemp -d)
+trap 'rm -rf $TMP' EXIT
+
+# the total .text size of the objects $@
+text() {
+  llvm-size -A "$@" | awk '$1 ~ /^\.text/ { n += $2 } END { print n + 0 }'
+}
+
+# the .text size size.json records for benchmark $1
+baseline() {
+  python3 -c 'import json, sys
+print(json.load(open(sys.argv[1])).get(sys.argv[2], {}).get("text", 0))' \
+    $EMBENCH_DIR/baseline-data/size.json $1
+}
+
+status=0
+printf "%-16s %9s %8s %8s %8s %8s\n" benchmark size.json base sr change sr/json
+for dir in $EMBENCH_DIR/src/*/; do
+  name=$(basename $dir)
+  for c in $dir*.c; do
+    o=$(basename $c .c).o
+    clang -c -Os "$@" $c -o $TMP/base-$o \
+      -I$dir -I$EMBENCH_DIR/support -DCPU_MHZ=1000 || exit 1
+    clang -c -Os "$@" -fpass-plugin=$PLUGIN $c -o $TMP/sr-$o \
+      -I$dir -I$EMBENCH_DIR/support -DCPU_MHZ=1000 || exit 1
+  done
+  base=$(text $TMP/base-*.o)
+  sr=$(text $TMP/sr-*.o)
+  ref=$(baseline $name)
+  # the change sr makes, and the size with sr relative to size.json
+  printf "%-16s %9d %8d %8d %7s%% %8s\n" $name $ref $base $sr \
+    $(awk -v a=$sr -v b=$base 'BEGIN { printf "%+.1f", b ? 100 * (a - b) / b : 0 }') \
+    $(awk -v a=$sr -v r=$ref 'BEGIN { printf "%.2f", r ? a / r : 0 }')
+  if [ $sr -gt $base ]; then
+    status=1
+  fi
+  rm -f $TMP/*.o
+done
+exit $status
@@ -1,242 +1,1758 @@
-#include "llvm/Analysis/TargetLibraryInfo.h"
-#include "llvm/Analysis/LoopInfo.h" 
-#include "llvm/Analysis/LoopPass.h"
+#include "llvm/ADT/APInt.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/BranchProbabilityInfo.h"
+#include "llvm/Analysis/ConstantFolding.h"
+#include "llvm/Analysis/LoopAnalysisManager.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/GetElementPtrTypeIterator.h"
 #include "llvm/IR/InstrTypes.h"
 #include "llvm/IR/IRBuilder.h"
-#include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
 #include "llvm/Pass.h"
-#include "llvm/Transforms/IPO/PassManagerBuilder.h"
-#include "llvm/Transforms/Scalar.h"
-#include "llvm/Transforms/Utils.h"
-#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/xxhash.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "llvm/Transforms/Scalar/LoopPassManager.h"
+#include "llvm/Transforms/Utils/ScalarEvolutionExpander.h"
+#include <cmath>
+#include <cstring>
 using namespace llvm;
 
-#include <tuple>
-#include <map>
-#include <iostream>
-using namespace std;
+#define DEBUG_TYPE "sr"
+
+STATISTIC(NumLoops, "Number of loops visited");
+STATISTIC(NumVisited, "Number of instructions visited by indvar discovery");
+STATISTIC(NumIndVars, "Number of induction variables discovered");
+STATISTIC(NumPhis, "Number of phi nodes inserted");
+STATISTIC(NumMulsRemoved, "Number of multiplies removed");
+STATISTIC(NumDivsRemoved, "Number of divisions and remainders removed");
+STATISTIC(NumExitTests, "Number of exit tests replaced");
+STATISTIC(NumBasicRemoved, "Number of basic induction variables removed");
+STATISTIC(NumNoPreheader, "Number of loops skipped for lack of a preheader");
+STATISTIC(NumNoIndVar, "Number of loops skipped for lack of a basic indvar");
+STATISTIC(NumUnprofitable, "Number of phi nodes not inserted as unprofitable");
+STATISTIC(NumOverBudget, "Number of phi nodes not inserted for lack of registers");
+STATISTIC(NumInstrumented, "Number of loops instrumented");
+STATISTIC(NumCold, "Number of loops skipped as cold");
+STATISTIC(NumKeptCanonical, "Number of innermost loops left to the vectorizer");
+
+static cl::opt<unsigned> MaxNewPhis(
+    "sr-max-new-phis", cl::init(8), cl::Hidden,
+    cl::desc("Maximum number of phi nodes strength reduction adds to a loop"));
+
+static cl::opt<bool> VectorizerFriendly(
+    "sr-vectorizer-friendly", cl::init(false), cl::Hidden,
+    cl::desc("Leave innermost loops alone for the loop vectorizer"));
+
+static cl::opt<double> FPErrorBound(
+    "sr-fp-error-bound", cl::init(0.0), cl::Hidden,
+    cl::desc("Largest relative rounding error a floating point phi may "
+             "accumulate over a loop (0 = no limit)"));
+
+static cl::opt<bool> Instrument(
+    "sr-instrument", cl::init(false), cl::Hidden,
+    cl::desc("Instrument loops with calls to the rtlib.c profiling runtime "
+             "instead of strength reducing them"));
+
+static cl::opt<std::string> ProfilePath(
+    "sr-profile", cl::Hidden, cl::value_desc("file"),
+    cl::desc("Loop profile written by the rtlib.c runtime, to tell hot "
+             "loops from cold ones instead of the PGO profile"));
+
+static cl::opt<unsigned> HotCutoff(
+    "sr-hot-cutoff", cl::init(990000), cl::Hidden,
+    cl::desc("Only reduce the hottest loops that make up this many parts "
+             "per million of the profile (0 = reduce every loop)"));
 
 namespace {
-  struct SkeletonPass : public FunctionPass {
-    static char ID;
-    SkeletonPass() : FunctionPass(ID) {}
-
-    void getAnalysisUsage(AnalysisUsage &AU) const {
-      AU.setPreservesCFG();
-      AU.addRequired<LoopInfoWrapperPass>();
-      AU.addRequired<TargetLibraryInfoWrapperPass>();
-    }
-
-    virtual bool runOnFunction(Function &F) {
-      // craete llvm function with
-      LLVMContext &Ctx = F.getContext();
-      std::vector<Type*> paramTypes = {Type::getInt32Ty(Ctx)};
-      Type *retType = Type::getVoidTy(Ctx);
-      FunctionType *logFuncType = FunctionType::get(retType, paramTypes, false);
-      Module* module = F.getParent();
-      Constant *logFunc = module->getOrInsertFunction("logop", logFuncType);
-
-      // perform constant prop and loop analysis
-      // should not call other passes with runOnFunction
-      // which may overwrite the original pass manager
-      LoopInfo &LI = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
-
-      // apply useful passes
-      legacy::FunctionPassManager FPM(module);
-      FPM.add(createConstantPropagationPass());
-      FPM.add(createIndVarSimplifyPass());
-      FPM.add(createDeadCodeEliminationPass());
-      FPM.add(createLoopSimplifyPass());
-      FPM.doInitialization();
-      bool changed = FPM.run(F);
-      FPM.doFinalization();
-
-
-      // find all loop induction variables within a loop
-      for(auto* L : LI) {
-        // IndVarMap = {indvar: indvar tuple}
-        // indvar tuple = (basic_indvar, scale, const)
-        // indvar = basic_indvar * scale + const
-        map<Value*, tuple<Value*, int, int> > IndVarMap;
-
-        // all induction variables should have phi nodes in the header
-        // notice that this might add additional variables, they are treated as basic induction
-        // variables for now
-        // the preheader block
-        BasicBlock* b_preheader = L->getLoopPreheader();
-        // the header block
-        BasicBlock* b_header = L->getHeader();
-        // the body block
-        BasicBlock* b_body;
-
-        for (auto &I : *b_header) {
-          if (PHINode *PN = dyn_cast<PHINode>(&I)) {
-            IndVarMap[&I] = make_tuple(&I, 1, 0);
+  // an induction variable of the form basic * scale + offset + inv * inv_scale,
+  // where basic is a phi node in the loop header and inv, if any, is a loop
+  // invariant value such as the row offset in i * 3 + base
+  // scale, offset and inv_scale have the bit width of the indvar and wrap
+  // like it does; NSW/NUW record that every step from basic to this value
+  // was exact in the signed/unsigned sense, which is what lets the new
+  // increments keep the no-wrap flags
+  struct IndVar {
+    Value* V;
+    PHINode* Basic;
+    APInt Scale;
+    APInt Offset;
+    Value* Inv;
+    APInt InvScale;
+    bool NSW;
+    bool NUW;
+
+    bool isBasic() const { return Scale.isOne() && Offset.isZero() && !Inv; }
+
+    // whether computing the indvar from its basic one takes a multiply
+    bool multiplies() const {
+      return !Scale.isOne() || (Inv && !InvScale.isOne());
+    }
+
+    // whether the two indvars differ by a constant only
+    bool isOffsetOf(const IndVar &O) const {
+      return Basic == O.Basic && Scale == O.Scale && Inv == O.Inv &&
+             (!Inv || InvScale == O.InvScale);
+    }
+  };
+
+  // IndVarTable = {indvar: IndVar record}
+  // the records are bump allocated and also kept in discovery order, so
+  // walking the table is deterministic and lookups are a single probe
+  class IndVarTable {
+    SpecificBumpPtrAllocator<IndVar> Allocator;
+    DenseMap<Value*, IndVar*> Map;
+    SmallVector<IndVar*, 16> Order;
+
+  public:
+    IndVar* lookup(Value* V) const { return Map.lookup(V); }
+    unsigned size() const { return Order.size(); }
+
+    IndVar* insert(Value* V, PHINode* Basic, const APInt &Scale,
+                   const APInt &Offset, Value* Inv, const APInt &InvScale,
+                   bool NSW, bool NUW) {
+      IndVar*& Slot = Map[V];
+      if (!Slot) {
+        Slot = new (Allocator.Allocate())
+            IndVar{V, Basic, Scale, Offset, Inv, InvScale, NSW, NUW};
+        Order.push_back(Slot);
+      }
+      return Slot;
+    }
+
+    SmallVectorImpl<IndVar*>::const_iterator begin() const { return Order.begin(); }
+    SmallVectorImpl<IndVar*>::const_iterator end() const { return Order.end(); }
+    SmallVectorImpl<IndVar*>::const_reverse_iterator rbegin() const { return Order.rbegin(); }
+    SmallVectorImpl<IndVar*>::const_reverse_iterator rend() const { return Order.rend(); }
+  };
+
+  // a floating point induction variable conv(int) * scale + offset, where
+  // conv is the sitofp or uitofp of integer indvar int, and scale and
+  // offset are loop invariant, with null standing for 1.0 and 0.0
+  // turning it into a phi reassociates the arithmetic, so every operation
+  // on the way must allow that; FMF is what they all have in common
+  struct FPIndVar {
+    IndVar* Int;
+    CastInst* Conv;
+    Value* Scale;
+    Value* Offset;
+    FastMathFlags FMF;
+  };
+
+  // FPIndVarTable = {indvar: FPIndVar record}, in discovery order
+  using FPIndVarTable = MapVector<Value*, FPIndVar>;
+
+  // an address computation getelementptr base, ..., index, ... with a loop
+  // invariant base whose only variable index is an indvar, possibly behind
+  // an explicit sext or zext
+  struct AddrRec {
+    GetElementPtrInst* GEP;
+    unsigned Pos;
+    IndVar* Index;
+    CastInst* Ext;
+  };
+
+  // how the address of an AddrRec moves with its index: the index is
+  // extended to the pointer index width, signed or not, and scaled by the
+  // size of the element it indexes
+  struct AddrStride {
+    bool Signed;
+    unsigned IndexWidth;
+    uint64_t ElemSize;
+
+    // the distance in bytes covered by an exact index distance V
+    APInt toBytes(const APInt &V) const {
+      APInt wide = Signed ? V.sextOrTrunc(IndexWidth) : V.zextOrTrunc(IndexWidth);
+      return wide * APInt(IndexWidth, ElemSize);
+    }
+  };
+
+  // a basic indvar that takes the same step on every backedge, with the
+  // phis that replaced its derived indvars and how far each of them
+  // advances per step
+  struct ReducedIndVar {
+    PHINode* Basic;
+    SmallVector<IndVar*, 2> Steps;
+    SmallVector<std::pair<PHINode*, APInt>, 4> Phis;
+  };
+
+  // whether the function the loop is in wants small code over fast code,
+  // which turns the cost model from latencies to instruction counts
+  static bool optimizeForSize(const Loop* L) {
+    return L->getHeader()->getParent()->hasOptSize();
+  }
+
+  // decides which indvars get a phi of their own: a new phi saves
+  // recomputing the indvar on every iteration, but pays for an increment
+  // instead and keeps a register busy across the whole loop, which on
+  // targets with few registers can cost more in spills than it saves
+  class ReductionCost {
+    const TargetTransformInfo &TTI;
+    const DataLayout &DL;
+    const bool SizeMode;
+    const TargetTransformInfo::TargetCostKind CostKind;
+    unsigned Budget;
+    unsigned Rejected = 0;
+    unsigned Sites = 1;
+    SmallPtrSet<Value*, 8> Declined;
+
+    InstructionCost arith(unsigned Opcode, Type* Ty) const {
+      return TTI.getArithmeticInstrCost(Opcode, Ty, CostKind,
+                                        TargetTransformInfo::OK_AnyValue,
+                                        TargetTransformInfo::OK_UniformConstantValue);
+    }
+
+  public:
+    // the number of phis the cost model turned down
+    unsigned rejected() const { return Rejected; }
+
+    // the values whose phi was turned down, so that a later phase does
+    // not weigh, and count, the same phi again
+    void decline(Value* V) { Declined.insert(V); }
+    bool declined(Value* V) const { return Declined.count(V); }
+
+    ReductionCost(Loop* L, const TargetTransformInfo &TTI)
+        : TTI(TTI), DL(L->getHeader()->getModule()->getDataLayout()),
+          SizeMode(optimizeForSize(L)),
+          CostKind(SizeMode ? TargetTransformInfo::TCK_CodeSize
+                            : TargetTransformInfo::TCK_Latency) {
+      // the values that stay live across the whole loop are its header
+      // phis and the loop invariants it uses; the new phis get what is
+      // left of the registers, and never more than -sr-max-new-phis
+      SmallPtrSet<Value*, 16> Live;
+      for (PHINode &PN : L->getHeader()->phis()) Live.insert(&PN);
+      for (auto* B : L->blocks())
+        for (auto &I : *B)
+          for (Value* Op : I.operands())
+            if ((isa<Instruction>(Op) || isa<Argument>(Op)) && L->isLoopInvariant(Op))
+              Live.insert(Op);
+      unsigned regs = TTI.getNumberOfRegisters(TTI.getRegisterClassForType(false));
+      Budget = std::min<unsigned>(MaxNewPhis, regs > Live.size() ? regs - Live.size() : 0);
+    }
+
+    // the cost of computing basic * scale + offset from the basic indvar
+    InstructionCost recompute(const IndVar* t) const {
+      Type* Ty = t->V->getType();
+      InstructionCost cost = 0;
+      if (!t->Scale.isOne())
+        cost += arith(t->Scale.isPowerOf2() ? Instruction::Shl : Instruction::Mul, Ty);
+      if (!t->Offset.isZero())
+        cost += arith(Instruction::Add, Ty);
+      if (t->Inv && !t->InvScale.isOne())
+        cost += arith(t->InvScale.isPowerOf2() ? Instruction::Shl : Instruction::Mul, Ty);
+      if (t->Inv)
+        cost += arith(Instruction::Add, Ty);
+      return cost;
+    }
+
+    // the same for an address, which also extends the index and scales it
+    // by the element size, unless the target folds that into the access
+    InstructionCost recompute(const AddrRec &A, const AddrStride &S) const {
+      InstructionCost cost = recompute(A.Index);
+      Type* IdxTy = A.Index->V->getType();
+      Type* WideTy = IntegerType::get(IdxTy->getContext(), S.IndexWidth);
+      if (IdxTy != WideTy)
+        cost += TTI.getCastInstrCost(
+            CastInst::getCastOpcode(A.Index->V, S.Signed, WideTy, S.Signed), WideTy,
+            IdxTy, TargetTransformInfo::CastContextHint::None, CostKind);
+      if (!TTI.isLegalAddressingMode(A.GEP->getResultElementType(), nullptr, 0, true,
+                                     S.ElemSize))
+        cost += arith(isPowerOf2_64(S.ElemSize) ? Instruction::Shl : Instruction::Mul,
+                      WideTy) + arith(Instruction::Add, WideTy);
+      return cost;
+    }
+
+    // the cost of converting and scaling a floating point indvar
+    InstructionCost recompute(const FPIndVar &r) const {
+      Type* Ty = r.Conv->getType();
+      InstructionCost cost = TTI.getInstructionCost(r.Conv, CostKind);
+      if (r.Scale) cost += arith(Instruction::FMul, Ty);
+      if (r.Offset) cost += arith(Instruction::FAdd, Ty);
+      return cost;
+    }
+
+    // the cost of a division or remainder by a constant; targets cost
+    // these like a multiply, as that is what they expand them to, or not
+    // at all on cores that call a library routine instead, so unless it
+    // is an unsigned one by a power of two, i.e. a shift or a mask, take
+    // it to be expensive; in size mode it is a single instruction or call
+    InstructionCost recomputeDivRem(BinaryOperator* I) const {
+      if (SizeMode) return TargetTransformInfo::TCC_Basic;
+      InstructionCost cost = TTI.getInstructionCost(I, CostKind);
+      bool is_signed = I->getOpcode() == Instruction::SDiv ||
+                       I->getOpcode() == Instruction::SRem;
+      if (!is_signed && cast<ConstantInt>(I->getOperand(1))->getValue().isPowerOf2())
+        return cost;
+      return std::max(cost, InstructionCost(TargetTransformInfo::TCC_Expensive));
+    }
+
+    // the cost of advancing a remainder counter: add, compare, select
+    InstructionCost counterStep(Type* Ty) const {
+      Type* CondTy = Type::getInt1Ty(Ty->getContext());
+      return arith(Instruction::Add, Ty) +
+             TTI.getCmpSelInstrCost(Instruction::ICmp, Ty, CondTy, CmpInst::ICMP_UGE,
+                                    CostKind) +
+             TTI.getCmpSelInstrCost(Instruction::Select, Ty, CondTy,
+                                    CmpInst::BAD_ICMP_PREDICATE,
+                                    CostKind);
+    }
+
+    // the cost of an instruction scalar evolution would replace
+    InstructionCost recompute(Instruction* I) const {
+      return TTI.getInstructionCost(I, CostKind);
+    }
+
+    // the number of paths back to the header that the next phis take a
+    // step on, each with an increment of its own
+    void setStepSites(unsigned N) { Sites = N; }
+
+    // the cost of the start value of a phi in the preheader, which is
+    // only paid once and so only counts in size mode: as much as the
+    // value it replaces, unless it folds to a constant
+    InstructionCost start(InstructionCost Saved, bool Folds) const {
+      return SizeMode && !Folds ? Saved : 0;
+    }
+
+    // the same for the start value of a phi for indvar t, computed from
+    // the value Basic of its basic indvar: only what expandIndVar emits
+    // counts, so nothing of a constant part that folds, and no add of it
+    // when it folds to zero
+    InstructionCost start(const IndVar* t, Value* Basic) const {
+      if (!SizeMode) return 0;
+      if (!isa<Constant>(Basic)) return recompute(t);
+      if (!t->Inv) return 0;
+      Type* Ty = t->V->getType();
+      InstructionCost cost = 0;
+      if (!t->InvScale.isOne())
+        cost += arith(t->InvScale.isPowerOf2() ? Instruction::Shl : Instruction::Mul, Ty);
+      auto *C = dyn_cast<ConstantInt>(Basic);
+      if (!C || !(C->getValue() * t->Scale + t->Offset).isZero())
+        cost += arith(Instruction::Add, Ty);
+      return cost;
+    }
+
+    // whether N stacked phis of type Ty that save recomputing a value of
+    // cost Saved are worth their increments and still fit in the
+    // registers; the target costs rarely tell a multiply from an add, so
+    // when the recomputation multiplies, ties go to the phis, as they also
+    // take the value off the dependence chain of the basic indvar, and
+    // stacked increments run side by side; one that only adds is no
+    // slower than an increment and needs no register of its own, so there
+    // ties keep the recomputation
+    // in size mode every increment is an instruction, and so is the
+    // start value, and the phi itself may take a copy, so a phi must save
+    // more instructions than it adds
+    bool takePhi(InstructionCost Saved, Type* Ty, unsigned N = 1,
+                 InstructionCost Start = 0, bool Multiplies = true) {
+      Type* StepTy = Ty->isPointerTy() ? DL.getIndexType(Ty) : Ty;
+      unsigned add = StepTy->isFloatingPointTy() ? Instruction::FAdd : Instruction::Add;
+      return takePhis(Saved, arith(add, StepTy), N, Start, Multiplies);
+    }
+
+    // the same for phis that take a step of cost Step instead of an add
+    bool takePhis(InstructionCost Saved, InstructionCost Step, unsigned N,
+                  InstructionCost Start = 0, bool Multiplies = true) {
+      if (SizeMode) Step = Step * (N * Sites) + Start;
+      if (Budget < N) {
+        ++NumOverBudget;
+        ++Rejected;
+        return false;
+      }
+      if (Saved < Step || ((SizeMode || !Multiplies) && Saved == Step)) {
+        ++NumUnprofitable;
+        ++Rejected;
+        return false;
+      }
+      Budget -= N;
+      return true;
+    }
+  };
+
+  // one phase of the pass: a timer in the "sr" group of the -time-passes
+  // report and a scope in the -ftime-trace profile; both cost nothing
+  // unless the flag is given
+  struct PhaseTimer {
+    NamedRegionTimer Timer;
+    TimeTraceScope Trace;
+
+    PhaseTimer(StringRef Name, StringRef Desc)
+      : Timer(Name, Desc, DEBUG_TYPE, "Strength Reduction", TimePassesIsEnabled),
+        Trace(Desc) {}
+  };
+
+  // the loop pass manager hands us loops innermost first, and guarantees
+  // they are in loop-simplify and LCSSA form, so every loop has a
+  // preheader and a single backedge by the time we see it
+  struct SkeletonPass : public PassInfoMixin<SkeletonPass> {
+    // try to express a binary operator in terms of a known indvar
+    // we only accept addition, subtraction, multiplication and left shift
+    // with a constant integer as the other operand, and addition and
+    // subtraction of a single loop invariant value
+    static bool classify(BinaryOperator* op, Loop* L, IndVarTable &IndVars) {
+      Value *lhs = op->getOperand(0);
+      Value *rhs = op->getOperand(1);
+      IndVar* t = IndVars.lookup(lhs);
+      Value* other = rhs;
+      bool swapped = false;
+      if (!t) {
+        t = IndVars.lookup(rhs);
+        other = lhs;
+        swapped = true;
+      }
+      if (!t) return false;
+      ConstantInt* CI = dyn_cast<ConstantInt>(other);
+      if (!CI) return classifyInvariant(op, t, other, swapped, L, IndVars);
+
+      // the folds are done in the indvar's own bit width, so they wrap
+      // exactly like the instructions they replace; an overflowing fold is
+      // still correct modulo 2^n, it just means the value is no longer
+      // exact and the no-wrap flags have to go
+      APInt c = CI->getValue();
+      unsigned width = c.getBitWidth();
+      bool nsw = t->NSW && op->hasNoSignedWrap();
+      bool nuw = t->NUW && op->hasNoUnsignedWrap();
+      bool sov = false, uov = false;
+      APInt scale = t->Scale, offset = t->Offset, inv_scale = t->InvScale;
+      unsigned opcode = op->getOpcode();
+      // a shift by a constant amount is a multiply by a power of two, but
+      // only the shifted operand may be the indvar
+      if (opcode == Instruction::Shl) {
+        if (swapped || c.uge(width)) return false;
+        unsigned amount = c.getZExtValue();
+        // shl nsw into the sign bit is not the same as mul nsw
+        nsw &= amount + 1 < width;
+        c = APInt::getOneBitSet(width, amount);
+        opcode = Instruction::Mul;
+      }
+      switch (opcode) {
+      case Instruction::Add:
+        offset = t->Offset.sadd_ov(c, sov);
+        (void)t->Offset.uadd_ov(c, uov);
+        break;
+      case Instruction::Sub:
+        // c - (basic * scale + offset) flips the sign of the scale
+        if (swapped) {
+          scale = APInt::getZero(c.getBitWidth()).ssub_ov(t->Scale, sov);
+          bool sov2, sov3;
+          offset = c.ssub_ov(t->Offset, sov2);
+          inv_scale = APInt::getZero(c.getBitWidth()).ssub_ov(t->InvScale, sov3);
+          sov |= sov2 || sov3;
+        } else {
+          offset = t->Offset.ssub_ov(c, sov);
+        }
+        // the unsigned offset of a difference is not tracked
+        uov = true;
+        break;
+      case Instruction::Mul: {
+        bool sov2, uov2, sov3, uov3;
+        scale = t->Scale.smul_ov(c, sov);
+        offset = t->Offset.smul_ov(c, sov2);
+        inv_scale = t->InvScale.smul_ov(c, sov3);
+        (void)t->Scale.umul_ov(c, uov);
+        (void)t->Offset.umul_ov(c, uov2);
+        (void)t->InvScale.umul_ov(c, uov3);
+        sov |= sov2 || sov3;
+        uov |= uov2 || uov3;
+        break;
+      }
+      default:
+        return false;
+      }
+      IndVars.insert(op, t->Basic, scale, offset, t->Inv, inv_scale,
+                     nsw && !sov, nuw && !uov);
+      return true;
+    }
+
+    // add or subtract a loop invariant value inv to indvar t; the value is
+    // carried along symbolically and only evaluated in the preheader, so an
+    // indvar can hold at most one of them
+    static bool classifyInvariant(BinaryOperator* op, IndVar* t, Value* inv,
+                                  bool swapped, Loop* L, IndVarTable &IndVars) {
+      if (t->Inv || !L->isLoopInvariant(inv)) return false;
+      unsigned width = t->Scale.getBitWidth();
+      bool nsw = t->NSW && op->hasNoSignedWrap();
+      bool nuw = t->NUW && op->hasNoUnsignedWrap();
+      bool sov = false;
+      APInt scale = t->Scale, offset = t->Offset, inv_scale(width, 1);
+      switch (op->getOpcode()) {
+      case Instruction::Add:
+        break;
+      case Instruction::Sub:
+        // inv - (basic * scale + offset) flips the sign of both
+        if (swapped) {
+          bool sov2;
+          scale = APInt::getZero(width).ssub_ov(t->Scale, sov);
+          offset = APInt::getZero(width).ssub_ov(t->Offset, sov2);
+          sov |= sov2;
+        } else {
+          inv_scale = APInt::getAllOnes(width);
+        }
+        nuw = false;
+        break;
+      default:
+        return false;
+      }
+      IndVars.insert(op, t->Basic, scale, offset, inv, inv_scale, nsw && !sov, nuw);
+      return true;
+    }
+
+    // floating point indvars start where an integer indvar is converted,
+    // which is only linear while the integer never wraps in the sense of
+    // the conversion, and grow from there like the integer ones do
+    static void discoverFPIndVars(Loop* L, const IndVarTable &IndVars,
+                                  FPIndVarTable &FPIndVars) {
+      SmallVector<Value*, 16> Worklist;
+      for (IndVar* t : IndVars) {
+        for (User* U : t->V->users()) {
+          auto *Conv = dyn_cast<CastInst>(U);
+          if (!Conv || !L->contains(Conv)) continue;
+          bool is_signed = Conv->getOpcode() == Instruction::SIToFP;
+          if (!is_signed && Conv->getOpcode() != Instruction::UIToFP) continue;
+          if (is_signed ? !t->NSW : !t->NUW) continue;
+          FPIndVars.insert({Conv, FPIndVar{t, Conv, nullptr, nullptr,
+                                           FastMathFlags::getFast()}});
+          Worklist.push_back(Conv);
+        }
+      }
+      while (!Worklist.empty()) {
+        Value* V = Worklist.pop_back_val();
+        for (User* U : V->users()) {
+          auto *op = dyn_cast<BinaryOperator>(U);
+          if (!op || !L->contains(op) || FPIndVars.count(op)) continue;
+          ++NumVisited;
+          if (classifyFP(op, L, FPIndVars)) Worklist.push_back(op);
+        }
+      }
+    }
+
+    // try to express a floating point operation in terms of a known
+    // floating point indvar: fmul by, and fadd of, a loop invariant, or
+    // fsub of a constant, all with reassociation allowed; combining two
+    // invariants takes them to be constants, anything else would need
+    // code in the preheader before we know the indvar gets a phi
+    static bool classifyFP(BinaryOperator* op, Loop* L, FPIndVarTable &FPIndVars) {
+      if (!op->hasAllowReassoc()) return false;
+      Value *lhs = op->getOperand(0);
+      Value *rhs = op->getOperand(1);
+      auto It = FPIndVars.find(lhs);
+      Value* other = rhs;
+      bool swapped = false;
+      if (It == FPIndVars.end()) {
+        It = FPIndVars.find(rhs);
+        other = lhs;
+        swapped = true;
+      }
+      if (It == FPIndVars.end() || !L->isLoopInvariant(other)) return false;
+
+      const DataLayout &DL = op->getModule()->getDataLayout();
+      // fold B into A, where a null A is the identity of the operation
+      auto fold = [&](unsigned Opcode, Value* A, Value* B) -> Value* {
+        if (!A) return B;
+        auto *CA = dyn_cast<Constant>(A);
+        auto *CB = dyn_cast<Constant>(B);
+        return CA && CB ? ConstantFoldBinaryOpOperands(Opcode, CA, CB, DL) : nullptr;
+      };
+      FPIndVar r = It->second;
+      switch (op->getOpcode()) {
+      case Instruction::FSub: {
+        auto *C = dyn_cast<Constant>(other);
+        if (swapped || !C) return false;
+        other = ConstantFoldUnaryOpOperand(Instruction::FNeg, C, DL);
+        if (!other) return false;
+        LLVM_FALLTHROUGH;
+      }
+      case Instruction::FAdd:
+        r.Offset = fold(Instruction::FAdd, r.Offset, other);
+        if (!r.Offset) return false;
+        break;
+      case Instruction::FMul:
+        r.Scale = fold(Instruction::FMul, r.Scale, other);
+        if (!r.Scale) return false;
+        if (r.Offset) {
+          r.Offset = fold(Instruction::FMul, r.Offset, other);
+          if (!r.Offset) return false;
+        }
+        break;
+      default:
+        return false;
+      }
+      // a scale of one, or an offset of zero where the sign of a zero
+      // result does not matter, changes nothing, so it is left out of the
+      // start value and of the cost
+      if (auto *C = dyn_cast_or_null<ConstantFP>(r.Scale))
+        if (C->isExactlyValue(1.0)) r.Scale = nullptr;
+      if (auto *C = dyn_cast_or_null<ConstantFP>(r.Offset))
+        if (C->isZero() && (C->isNegative() || op->hasNoSignedZeros())) r.Offset = nullptr;
+      r.FMF &= op->getFastMathFlags();
+      FPIndVars.insert({op, r});
+      return true;
+    }
+
+    // the increments of a floating point phi round, so after n iterations
+    // its value can be off by about n units in the last place; with
+    // -sr-fp-error-bound that has to stay below the bound for the largest
+    // trip count scalar evolution can prove
+    static bool isFPErrorBounded(Loop* L, Type* Ty, ScalarEvolution &SE) {
+      if (FPErrorBound <= 0) return true;
+      auto *Max = dyn_cast<SCEVConstant>(SE.getConstantMaxBackedgeTakenCount(L));
+      if (!Max) return false;
+      int precision = APFloat::semanticsPrecision(Ty->getFltSemantics());
+      double trips = Max->getAPInt().roundToDouble(false) + 1;
+      return trips * std::ldexp(1.0, -precision) <= FPErrorBound;
+    }
+
+    // match a getelementptr that walks memory with an indvar: the base is
+    // loop invariant and every index but one is a constant
+    static bool matchAddrRec(GetElementPtrInst* GEP, Loop* L,
+                             const IndVarTable &IndVars, AddrRec &A) {
+      if (!GEP->getType()->isPointerTy() ||
+          !L->isLoopInvariant(GEP->getPointerOperand())) return false;
+      A = {GEP, 0, nullptr, nullptr};
+      for (unsigned i = 1, e = GEP->getNumOperands(); i != e; ++i) {
+        if (isa<Constant>(GEP->getOperand(i))) continue;
+        if (A.Pos) return false;
+        A.Pos = i;
+      }
+      if (!A.Pos) return false;
+      Value* idx = GEP->getOperand(A.Pos);
+      if (auto *CI = dyn_cast<CastInst>(idx)) {
+        if (CI->getOpcode() != Instruction::SExt &&
+            CI->getOpcode() != Instruction::ZExt) return false;
+        A.Ext = CI;
+        idx = CI->getOperand(0);
+      }
+      A.Index = IndVars.lookup(idx);
+      return A.Index != nullptr;
+    }
+
+    // whether every use of V is in something the rewrite already made
+    // dead, directly or through a cast
+    static bool isDeadAfterRewrite(Value* V, const SmallPtrSetImpl<Value*> &Dead) {
+      for (User* U : V->users()) {
+        if (Dead.count(U)) continue;
+        if (isa<CastInst>(U) && isDeadAfterRewrite(U, Dead)) continue;
+        return false;
+      }
+      return true;
+    }
+
+    // whether V, flowing from block B towards the header, is the basic
+    // indvar PN advanced by a constant step, collecting the steps; loop
+    // simplification funnels several latches (continue statements) through
+    // one backedge block, so V may also be a phi there merging such values
+    static bool collectSteps(Value* V, BasicBlock* B, PHINode* PN, Loop* L,
+                             const IndVarTable &IndVars,
+                             SmallVectorImpl<IndVar*> &Steps, unsigned depth = 0) {
+      if (IndVar* t = IndVars.lookup(V)) {
+        if (t->Basic != PN || !t->Scale.isOne() || t->Inv) return false;
+        Steps.push_back(t);
+        return true;
+      }
+      auto *Merge = dyn_cast<PHINode>(V);
+      if (!Merge || Merge->getParent() != B || B == L->getHeader() || depth > 2)
+        return false;
+      for (unsigned i = 0, e = Merge->getNumIncomingValues(); i != e; ++i) {
+        BasicBlock* Pred = Merge->getIncomingBlock(i);
+        if (!L->contains(Pred) ||
+            !collectSteps(Merge->getIncomingValue(i), Pred, PN, L, IndVars,
+                          Steps, depth + 1)) return false;
+      }
+      return true;
+    }
+
+    // give a new phi its preheader value, and on every backedge the value
+    // that matches how the basic indvar PN advanced on the way there: the
+    // increment makeStep builds at the end of each latch for its step, and
+    // a phi wherever PN's steps were merged; a latch that reaches the same
+    // block along several edges still gets a single increment
+    static void addIncomings(PHINode* new_phi, PHINode* PN, BasicBlock* b_preheader,
+                             Value* new_incoming, const IndVarTable &IndVars,
+                             function_ref<Value*(IRBuilder<>&, IndVar*)> makeStep) {
+      SmallDenseMap<std::pair<BasicBlock*, Value*>, Value*, 4> Cache;
+      std::function<Value*(Value*, BasicBlock*)> advance =
+          [&](Value* V, BasicBlock* B) -> Value* {
+        Value*& new_val = Cache[{B, V}];
+        if (new_val) return new_val;
+        if (IndVar* t = IndVars.lookup(V)) {
+          IRBuilder<> body_builder(B->getTerminator());
+          return new_val = makeStep(body_builder, t);
+        }
+        PHINode* Merge = cast<PHINode>(V);
+        PHINode* new_merge = PHINode::Create(new_phi->getType(),
+            Merge->getNumIncomingValues(), "", Merge);
+        new_val = new_merge;
+        for (unsigned i = 0, e = Merge->getNumIncomingValues(); i != e; ++i)
+          new_merge->addIncoming(advance(Merge->getIncomingValue(i),
+                                         Merge->getIncomingBlock(i)),
+                                 Merge->getIncomingBlock(i));
+        return new_merge;
+      };
+      for (unsigned i = 0, e = PN->getNumIncomingValues(); i != e; ++i) {
+        BasicBlock* B = PN->getIncomingBlock(i);
+        new_phi->addIncoming(B == b_preheader
+                                 ? new_incoming
+                                 : advance(PN->getIncomingValue(i), B), B);
+      }
+    }
+
+    // replace a floating point indvar by a phi that starts at its value on
+    // the first iteration and adds conv(scale * step) * scale for each
+    // step; the sum takes the fast-math flags of the original operations
+    static PHINode* reduceFPIndVar(const FPIndVar &r, PHINode* PN,
+                                   const IndVarTable &IndVars, Value* preheader_val,
+                                   IRBuilder<> &head_builder,
+                                   IRBuilder<> &preheader_builder) {
+      Type* Ty = r.Conv->getType();
+      IRBuilder<>::FastMathFlagGuard guard(preheader_builder);
+      preheader_builder.setFastMathFlags(r.FMF);
+      auto scale = [&](Value* val) {
+        return r.Scale ? preheader_builder.CreateFMul(val, r.Scale) : val;
+      };
+      Value* new_incoming = scale(preheader_builder.CreateCast(
+          r.Conv->getOpcode(), expandIndVar(preheader_builder, r.Int, preheader_val), Ty));
+      if (r.Offset)
+        new_incoming = preheader_builder.CreateFAdd(new_incoming, r.Offset);
+      PHINode* new_phi = head_builder.CreatePHI(Ty, PN->getNumIncomingValues());
+
+      // the integer never wraps, so a step is a signed distance even when
+      // the indvar itself is unsigned
+      addIncomings(new_phi, PN, preheader_builder.GetInsertBlock(), new_incoming,
+                   IndVars, [&](IRBuilder<> &body_builder, IndVar* step) {
+        Value* fp_step = scale(preheader_builder.CreateSIToFP(
+            ConstantInt::get(preheader_val->getType(), r.Int->Scale * step->Offset), Ty));
+        body_builder.setFastMathFlags(r.FMF);
+        return body_builder.CreateFAdd(new_phi, fp_step);
+      });
+      return new_phi;
+    }
+
+    // replace divisions and remainders of indvars of PN by constants with
+    // a pair of counters: while the indvar t advances by d = dq * c + dr,
+    // the remainder r advances by dr and wraps around at c, carrying into
+    // the quotient q, which advances by dq
+    // this needs t to increase without wrapping, and a signed t to start
+    // out non-negative, where signed and unsigned division agree
+    void reduceDivRems(Loop* L, PHINode* PN, ArrayRef<IndVar*> Steps,
+                       const IndVarTable &IndVars, Value* preheader_val,
+                       IRBuilder<> &head_builder, IRBuilder<> &preheader_builder,
+                       ScalarEvolution &SE, ReductionCost &Cost,
+                       SmallPtrSetImpl<Value*> &Dead) {
+      struct DivRem {
+        IndVar* Int;
+        APInt Divisor;
+        bool Signed;
+        SmallVector<BinaryOperator*, 2> Divs;
+        SmallVector<BinaryOperator*, 2> Rems;
+      };
+      SmallVector<DivRem, 4> Groups;
+      for (IndVar* t : IndVars) {
+        if (t->Basic != PN) continue;
+        for (User* U : t->V->users()) {
+          auto *op = dyn_cast<BinaryOperator>(U);
+          if (!op || !L->contains(op) || op->getOperand(0) != t->V || Dead.count(op))
+            continue;
+          unsigned opcode = op->getOpcode();
+          bool is_signed = opcode == Instruction::SDiv || opcode == Instruction::SRem;
+          bool is_div = opcode == Instruction::SDiv || opcode == Instruction::UDiv;
+          if (!is_signed && !is_div && opcode != Instruction::URem) continue;
+          // the remainder plus its step must not overflow, so c <= 2^(n-1)
+          auto *CI = dyn_cast<ConstantInt>(op->getOperand(1));
+          unsigned width = t->Scale.getBitWidth();
+          if (!CI || CI->getValue().ule(1) ||
+              CI->getValue().ugt(APInt::getSignedMinValue(width))) continue;
+          auto G = find_if(Groups, [&](const DivRem &D) {
+            return D.Int == t && D.Divisor == CI->getValue() && D.Signed == is_signed;
+          });
+          if (G == Groups.end())
+            G = Groups.insert(Groups.end(), DivRem{t, CI->getValue(), is_signed, {}, {}});
+          (is_div ? G->Divs : G->Rems).push_back(op);
+        }
+      }
+
+      for (DivRem &D : Groups) {
+        IndVar* t = D.Int;
+        bool increasing = all_of(Steps, [&](IndVar* step) {
+          bool sov, uov;
+          APInt d = t->Scale.smul_ov(step->Offset, sov);
+          (void)t->Scale.umul_ov(step->Offset, uov);
+          return d.isStrictlyPositive() &&
+                 (D.Signed ? t->NSW && step->NSW && !sov : t->NUW && step->NUW && !uov);
+        });
+        if (!increasing) continue;
+        if (D.Signed) {
+          auto *Rec = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(t->V));
+          if (!Rec || Rec->getLoop() != L || !SE.isKnownNonNegative(Rec->getStart()))
+            continue;
+        }
+        InstructionCost saved = 0;
+        for (BinaryOperator* op : concat<BinaryOperator*>(D.Divs, D.Rems))
+          saved += Cost.recomputeDivRem(op);
+        Type* Ty = t->V->getType();
+        if (!Cost.takePhis(saved, Cost.counterStep(Ty), 2,
+                           Cost.start(t, preheader_val) +
+                           Cost.start(saved, isa<Constant>(preheader_val) && !t->Inv)))
+          continue;
+
+        // the division in the preheader happens once, for the start value
+        Value* start = expandIndVar(preheader_builder, t, preheader_val);
+        Value* divisor = ConstantInt::get(Ty, D.Divisor);
+        Value* q_start = preheader_builder.CreateUDiv(start, divisor);
+        Value* r_start = preheader_builder.CreateURem(start, divisor);
+        PHINode* r_phi = head_builder.CreatePHI(Ty, PN->getNumIncomingValues());
+        PHINode* q_phi = head_builder.CreatePHI(Ty, PN->getNumIncomingValues());
+
+        // the carry of each latch's remainder step feeds its quotient step
+        SmallDenseMap<std::pair<BasicBlock*, IndVar*>, Value*, 4> Carries;
+        addIncomings(r_phi, PN, preheader_builder.GetInsertBlock(), r_start, IndVars,
+                     [&](IRBuilder<> &body_builder, IndVar* step) -> Value* {
+          APInt dr = (t->Scale * step->Offset).urem(D.Divisor);
+          Value*& carry = Carries[{body_builder.GetInsertBlock(), step}];
+          if (dr.isZero()) {
+            carry = body_builder.getFalse();
+            return r_phi;
           }
+          Value* sum = body_builder.CreateAdd(r_phi, ConstantInt::get(Ty, dr), "", true);
+          carry = body_builder.CreateICmpUGE(sum, divisor);
+          return body_builder.CreateSelect(carry, body_builder.CreateNUWSub(sum, divisor), sum);
+        });
+        addIncomings(q_phi, PN, preheader_builder.GetInsertBlock(), q_start, IndVars,
+                     [&](IRBuilder<> &body_builder, IndVar* step) {
+          APInt dq = (t->Scale * step->Offset).udiv(D.Divisor);
+          Value* carry = Carries.lookup({body_builder.GetInsertBlock(), step});
+          Value* q = dq.isZero()
+                         ? q_phi
+                         : body_builder.CreateNUWAdd(q_phi, ConstantInt::get(Ty, dq));
+          return body_builder.CreateNUWAdd(q, body_builder.CreateZExt(carry, Ty));
+        });
+
+        for (BinaryOperator* op : D.Divs) {
+          op->replaceAllUsesWith(q_phi);
+          Dead.insert(op);
         }
-        
-        // get the total number of blocks as well as the block list
-        //cout << L->getNumBlocks() << "\n";
-        auto blks = L->getBlocks();
-
-        // find all indvars
-        // keep modifying the set until the size does not change
-        // notice that over here, our set of induction variables is not precise
-        while (true) {
-          map<Value*, tuple<Value*, int, int> > NewMap = IndVarMap;
-          // iterate through all blocks in the loop
-          for (auto B: blks) {
-            // iterate through all its instructions
-            for (auto &I : *B) {
-              // we only accept multiplication, addition, and subtraction
-              // we only accept constant integer as one of theoperands
-              if (auto *op = dyn_cast<BinaryOperator>(&I)) {
-                Value *lhs = op->getOperand(0);
-                Value *rhs = op->getOperand(1);
-                // check if one of the operands belongs to indvars
-                if (IndVarMap.count(lhs) || IndVarMap.count(rhs)) {
-                  // case: Add
-                  if (I.getOpcode() == Instruction::Add) {
-                    ConstantInt* CIL = dyn_cast<ConstantInt>(lhs);
-                    ConstantInt* CIR = dyn_cast<ConstantInt>(rhs);
-                    if (IndVarMap.count(lhs) && CIR) {
-                      tuple<Value*, int, int> t = IndVarMap[lhs];
-                      int new_val = CIR->getSExtValue() + get<2>(t);
-                      NewMap[&I] = make_tuple(get<0>(t), get<1>(t), new_val);
-                    } else if (IndVarMap.count(rhs) && CIL) {
-                      tuple<Value*, int, int> t = IndVarMap[rhs];
-                      int new_val = CIL->getSExtValue() + get<2>(t);
-                      NewMap[&I] = make_tuple(get<0>(t), get<1>(t), new_val);
-                    }
-                  // case: Sub
-                  } else if (I.getOpcode() == Instruction::Sub) {
-                    ConstantInt* CIL = dyn_cast<ConstantInt>(lhs);
-                    ConstantInt* CIR = dyn_cast<ConstantInt>(rhs);
-                    if (IndVarMap.count(lhs) && CIR) {
-                      tuple<Value*, int, int> t = IndVarMap[lhs];
-                      int new_val = get<2>(t) - CIR->getSExtValue();
-                      NewMap[&I] = make_tuple(get<0>(t), get<1>(t), new_val);
-                    } else if (IndVarMap.count(rhs) && CIL) {
-                      tuple<Value*, int, int> t = IndVarMap[rhs];
-                      int new_val = get<2>(t) - CIL->getSExtValue();
-                      NewMap[&I] = make_tuple(get<0>(t), get<1>(t), new_val);
-                    }
-                  // case: Mul
-                  } else if (I.getOpcode() == Instruction::Mul) {
-                    ConstantInt* CIL = dyn_cast<ConstantInt>(lhs);
-                    ConstantInt* CIR = dyn_cast<ConstantInt>(rhs);
-                    if (IndVarMap.count(lhs) && CIR) {
-                      tuple<Value*, int, int> t = IndVarMap[lhs];
-                      int new_val = CIR->getSExtValue() * get<1>(t);
-                      NewMap[&I] = make_tuple(get<0>(t), new_val, get<2>(t));
-                    } else if (IndVarMap.count(rhs) && CIL) {
-                      tuple<Value*, int, int> t = IndVarMap[rhs];
-                      int new_val = CIL->getSExtValue() * get<1>(t);
-                      NewMap[&I] = make_tuple(get<0>(t), new_val, get<2>(t));
-                    }
-                  }
-                } // if operand in indvar
-              } // if op is binop
-            } // auto &I: B
-          } // auto &B: blks
-          if (NewMap.size() == IndVarMap.size()) break;
-          else IndVarMap = NewMap;
-        }
-
-        // now modify the loop to apply strength reduction
-        map<Value*, PHINode*> PhiMap;
-        // note that after loop simplification
-        // we will only have a unique header and preheader
-        //
-
-        // modify the preheader block by inserting new phi nodes
-        Value* preheader_val;
-        Instruction* insert_pos = b_preheader->getTerminator();
-        for (auto &I : *b_header) {
-          // we insert at the first phi node
-          if (PHINode *PN = dyn_cast<PHINode>(&I)) {
-            int num_income = PN->getNumIncomingValues();
-            assert(num_income == 2);
-            // find the preheader value of the phi node
-            for (int i = 0; i < num_income; i++) {
-              if (PN->getIncomingBlock(i) == b_preheader) {
-                preheader_val = PN->getIncomingValue(i);
-                } else {
-                b_body = PN->getIncomingBlock(i);
-              }
-            }
-            IRBuilder<> head_builder(&I);
-            IRBuilder<> preheader_builder(insert_pos);
-            for (auto &indvar: IndVarMap) {
-              tuple<Value*, int, int> t = indvar.second;
-              if (get<0>(t) == PN && (get<1>(t) != 1 || get<2>(t) != 0)) { // not a basic indvar
-                // calculate the new indvar according to the preheader value
-                Value* new_incoming = preheader_builder.CreateMul(preheader_val, 
-                  ConstantInt::getSigned(preheader_val->getType(), get<1>(t)));
-                new_incoming = preheader_builder.CreateAdd(new_incoming, 
-                  ConstantInt::getSigned(preheader_val->getType(), get<2>(t)));
-                PHINode* new_phi = head_builder.CreatePHI(preheader_val->getType(), 2);
-                new_phi->addIncoming(new_incoming, b_preheader);
-                PhiMap[indvar.first] = new_phi;
-              }
-            }
+        for (BinaryOperator* op : D.Rems) {
+          op->replaceAllUsesWith(r_phi);
+          Dead.insert(op);
+        }
+      }
+    }
+
+    // compute indvar t from the value basic of its basic indvar; the loop
+    // invariant part only depends on where the builder is, which is the
+    // preheader for the start value of every new phi; multiplies by one
+    // and adds of zero are left out
+    static Value* expandIndVar(IRBuilder<> &builder, const IndVar* t, Value* basic) {
+      Type* Ty = basic->getType();
+      Value* val = basic;
+      if (!t->Scale.isOne())
+        val = builder.CreateMul(val, ConstantInt::get(Ty, t->Scale));
+      if (!t->Offset.isZero())
+        val = builder.CreateAdd(val, ConstantInt::get(Ty, t->Offset));
+      if (!t->Inv) return val;
+      Value* inv = t->Inv;
+      if (!t->InvScale.isOne())
+        inv = builder.CreateMul(inv, ConstantInt::get(Ty, t->InvScale));
+      if (auto *C = dyn_cast<Constant>(val))
+        if (C->isNullValue()) return inv;
+      return builder.CreateAdd(val, inv);
+    }
+
+    // work out how an address computation moves for each step of its
+    // basic indvar, failing when that is not a fixed number of bytes
+    static bool getAddrStride(const AddrRec &A, ArrayRef<IndVar*> Steps,
+                              AddrStride &S) {
+      GetElementPtrInst* GEP = A.GEP;
+      IndVar* t = A.Index;
+      const DataLayout &DL = GEP->getModule()->getDataLayout();
+      unsigned index_width = DL.getIndexTypeSizeInBits(GEP->getType());
+      unsigned width = t->Scale.getBitWidth();
+
+      // the variable index steps over elements of the type it indexes
+      gep_type_iterator GTI = gep_type_begin(GEP);
+      std::advance(GTI, A.Pos - 1);
+      if (GTI.isStruct()) return false;
+      TypeSize elem_size = DL.getTypeAllocSize(GTI.getIndexedType());
+      if (elem_size.isScalable()) return false;
+
+      // a narrower index is sign extended by the getelementptr itself; an
+      // extended index only advances by the extended stride when the
+      // indvar never wraps in the sense of the extension
+      bool is_signed = A.Ext ? A.Ext->getOpcode() == Instruction::SExt
+                             : width < index_width;
+      bool extended = A.Ext || width < index_width;
+      for (IndVar* step : Steps) {
+        bool sov, uov;
+        (void)t->Scale.smul_ov(step->Offset, sov);
+        (void)t->Scale.umul_ov(step->Offset, uov);
+        if (extended && is_signed && !(t->NSW && step->NSW && !sov)) return false;
+        if (extended && !is_signed && !(t->NUW && step->NUW && !uov)) return false;
+      }
+      S = {is_signed, index_width, elem_size.getFixedSize()};
+      return true;
+    }
+
+    // whether two address computations walk the same memory in lockstep,
+    // i.e. differ only in the constant offset of their indvar index
+    static bool isSameWalk(const AddrRec &A, const AddrRec &B) {
+      if (A.Pos != B.Pos || !A.Index->isOffsetOf(*B.Index) ||
+          A.GEP->getSourceElementType() != B.GEP->getSourceElementType() ||
+          A.GEP->getNumOperands() != B.GEP->getNumOperands()) return false;
+      if (A.Ext || B.Ext) {
+        if (!A.Ext || !B.Ext || A.Ext->getOpcode() != B.Ext->getOpcode() ||
+            A.Ext->getType() != B.Ext->getType()) return false;
+      }
+      for (unsigned i = 0, e = A.GEP->getNumOperands(); i != e; ++i)
+        if (i != A.Pos && A.GEP->getOperand(i) != B.GEP->getOperand(i)) return false;
+      return true;
+    }
+
+    // replace an address computation by a pointer phi that starts at the
+    // address of the first iteration and advances by a fixed number of
+    // bytes for each step
+    static PHINode* reduceAddrRec(const AddrRec &A, const AddrStride &S, PHINode* PN,
+                                  const IndVarTable &IndVars,
+                                  Value* preheader_val, IRBuilder<> &head_builder,
+                                  IRBuilder<> &preheader_builder,
+                                  const DominatorTree &DT) {
+      GetElementPtrInst* GEP = A.GEP;
+      IndVar* t = A.Index;
+      const DataLayout &DL = GEP->getModule()->getDataLayout();
+
+      // the address of the first iteration, with the indvar evaluated on
+      // the preheader value of its basic indvar
+      Value* idx = expandIndVar(preheader_builder, t, preheader_val);
+      if (A.Ext)
+        idx = preheader_builder.CreateCast(A.Ext->getOpcode(), idx, A.Ext->getType());
+      SmallVector<Value*, 4> indices(GEP->idx_begin(), GEP->idx_end());
+      indices[A.Pos - 1] = idx;
+      Value* new_incoming = preheader_builder.CreateGEP(
+          GEP->getSourceElementType(), GEP->getPointerOperand(), indices);
+      PHINode* new_phi = head_builder.CreatePHI(GEP->getType(),
+                                                PN->getNumIncomingValues());
+
+      // advance by the byte stride; the increment stays inbounds when the
+      // original address was inbounds and is computed on every iteration
+      // that reaches the latch
+      Type* byte_ty = head_builder.getInt8Ty();
+      Type* raw_ty = byte_ty->getPointerTo(GEP->getType()->getPointerAddressSpace());
+      addIncomings(new_phi, PN, preheader_builder.GetInsertBlock(), new_incoming,
+                   IndVars, [&](IRBuilder<> &body_builder, IndVar* step) {
+        APInt stride = S.toBytes(t->Scale * step->Offset);
+        Value* raw = body_builder.CreateBitCast(new_phi, raw_ty);
+        Value* offset = ConstantInt::get(DL.getIndexType(GEP->getType()), stride);
+        BasicBlock* b_latch = body_builder.GetInsertBlock();
+        raw = DT.dominates(GEP->getParent(), b_latch) && GEP->isInBounds()
+                  ? body_builder.CreateInBoundsGEP(byte_ty, raw, offset)
+                  : body_builder.CreateGEP(byte_ty, raw, offset);
+        return body_builder.CreateBitCast(raw, GEP->getType());
+      });
+      return new_phi;
+    }
+
+    // the address Delta bytes past pointer P, computed right before the
+    // instruction it replaces
+    static Value* offsetPointer(Value* P, const APInt &Delta, Instruction* I) {
+      if (Delta.isZero()) return P;
+      IRBuilder<> use_builder(I);
+      Type* byte_ty = use_builder.getInt8Ty();
+      Type* raw_ty = byte_ty->getPointerTo(P->getType()->getPointerAddressSpace());
+      Value* raw = use_builder.CreateBitCast(P, raw_ty);
+      raw = use_builder.CreateGEP(byte_ty, raw, use_builder.getInt(Delta));
+      return use_builder.CreateBitCast(raw, P->getType());
+    }
+
+    // with -sr-vectorizer-friendly, innermost loops, the ones the loop
+    // vectorizer widens, are left as they are: every phi the pass adds is
+    // another induction for it to widen, or one it cannot widen at all,
+    // like remainder counters, stacked phis and floating point phis
+    static bool keepCanonical(Loop* L) {
+      return VectorizerFriendly && L->isInnermost();
+    }
+
+    // find all loop induction variables within a loop and replace the
+    // derived ones with cheaper phi nodes
+    bool reduceLoop(Loop* L, LoopStandardAnalysisResults &AR,
+                    OptimizationRemarkEmitter &ORE) {
+      IndVarTable IndVars;
+      ++NumLoops;
+
+      if (keepCanonical(L)) {
+        ++NumKeptCanonical;
+        ORE.emit([&]() {
+          return OptimizationRemarkMissed(DEBUG_TYPE, "VectorizerFriendly",
+                                          L->getStartLoc(), L->getHeader())
+                 << "loop not strength reduced: innermost loops are left "
+                    "to the loop vectorizer";
+        });
+        return false;
+      }
+
+      // the preheader block
+      BasicBlock* b_preheader = L->getLoopPreheader();
+      // loops without a dedicated preheader are not in simplified form
+      if (!b_preheader) {
+        ++NumNoPreheader;
+        ORE.emit([&]() {
+          return OptimizationRemarkMissed(DEBUG_TYPE, "NoPreheader",
+                                          L->getStartLoc(), L->getHeader())
+                 << "loop not strength reduced: it has no preheader";
+        });
+        return false;
+      }
+      // the header block
+      BasicBlock* b_header = L->getHeader();
+      Optional<PhaseTimer> Phase;
+      Phase.emplace("discovery", "SR indvar discovery");
+
+      // all induction variables should have phi nodes in the header
+      // notice that this might add additional variables, they are treated
+      // as basic induction variables for now
+      SmallVector<Value*, 32> Worklist;
+      for (auto &I : *b_header) {
+        PHINode *PN = dyn_cast<PHINode>(&I);
+        if (PN && PN->getType()->isIntegerTy()) {
+          unsigned width = PN->getType()->getIntegerBitWidth();
+          IndVars.insert(PN, PN, APInt(width, 1), APInt(width, 0), nullptr,
+                         APInt(width, 0), true, true);
+          Worklist.push_back(PN);
+        }
+      }
+
+      // grow the table along def-use chains: only the users of a newly
+      // classified value can become indvars, and a binary operator is
+      // looked at no more than once per operand
+      while (!Worklist.empty()) {
+        Value* V = Worklist.pop_back_val();
+        for (User* U : V->users()) {
+          auto *op = dyn_cast<BinaryOperator>(U);
+          if (!op || !L->contains(op) || IndVars.lookup(op)) continue;
+          ++NumVisited;
+          if (classify(op, L, IndVars)) Worklist.push_back(op);
+        }
+      }
+      FPIndVarTable FPIndVars;
+      discoverFPIndVars(L, IndVars, FPIndVars);
+      NumIndVars += IndVars.size() + FPIndVars.size();
+
+      // collect the address computations that walk memory with an indvar
+      SmallVector<AddrRec, 8> AddrRecs;
+      for (auto* B : L->blocks()) {
+        for (auto &I : *B) {
+          AddrRec A;
+          auto *GEP = dyn_cast<GetElementPtrInst>(&I);
+          if (GEP && matchAddrRec(GEP, L, IndVars, A))
+            AddrRecs.push_back(A);
+        }
+      }
+
+      // now modify the loop to apply strength reduction
+      Phase.emplace("rewrite", "SR rewrite");
+      // Dead = {values that were replaced, or only fed replaced values}
+      SmallPtrSet<Value*, 16> Dead;
+      SmallVector<ReducedIndVar, 4> Reduced;
+      ReductionCost Cost(L, AR.TTI);
+      SmallPtrSet<PHINode*, 8> OrigPhis;
+      for (PHINode &PN : b_header->phis()) OrigPhis.insert(&PN);
+      bool any_basic = false;
+      Instruction* insert_pos = b_preheader->getTerminator();
+      for (auto &I : *b_header) {
+        PHINode *PN = dyn_cast<PHINode>(&I);
+        if (!PN) break;
+        // find the preheader value of the phi node and its steps; the phi
+        // node is only a basic indvar if every value flowing back to the
+        // header is the phi node plus a constant step, though loops with
+        // continue statements may take a different step on each path
+        Value* preheader_val = PN->getIncomingValueForBlock(b_preheader);
+        SmallVector<IndVar*, 2> Steps;
+        bool is_basic = true;
+        for (unsigned i = 0, e = PN->getNumIncomingValues(); i != e && is_basic; ++i) {
+          BasicBlock* B = PN->getIncomingBlock(i);
+          if (B == b_preheader) continue;
+          is_basic = collectSteps(PN->getIncomingValue(i), B, PN, L, IndVars, Steps);
+        }
+        if (!is_basic || Steps.empty()) continue;
+        any_basic = true;
+        bool same_step = all_of(Steps, [&](IndVar* step) {
+          return step->Offset == Steps[0]->Offset;
+        });
+        ReducedIndVar R{PN, Steps, {}};
+        Cost.setStepSites(Steps.size());
+        // the start of a new phi folds when it only depends on a constant
+        // start of the basic indvar and constants
+        bool const_start = isa<Constant>(preheader_val);
+
+        IRBuilder<> head_builder(PN);
+        IRBuilder<> preheader_builder(insert_pos);
+
+        // addresses first: once a getelementptr has its own pointer phi,
+        // the indvar that only fed its index needs no phi of its own; an
+        // address that moves in lockstep with one that already has a phi,
+        // like a[i + 1] next to a[i], is that phi plus a constant instead
+        SmallVector<std::pair<AddrRec*, PHINode*>, 4> AddrLeaders;
+        for (AddrRec &A : AddrRecs) {
+          AddrStride S;
+          if (A.Index->Basic != PN || !getAddrStride(A, Steps, S)) continue;
+          auto Leader = find_if(AddrLeaders, [&](const std::pair<AddrRec*, PHINode*> &P) {
+            return isSameWalk(*P.first, A);
+          });
+          Value* new_val;
+          if (Leader != AddrLeaders.end()) {
+            APInt delta = S.toBytes(A.Index->Offset) -
+                          S.toBytes(Leader->first->Index->Offset);
+            new_val = offsetPointer(Leader->second, delta, A.GEP);
+          } else {
+            InstructionCost saved = Cost.recompute(A, S);
+            bool folds = const_start && !A.Index->Inv &&
+                         all_of(A.GEP->operands(), [&](Use &U) {
+                           return U.getOperandNo() == A.Pos || isa<Constant>(U);
+                         });
+            if (!Cost.takePhi(saved, A.GEP->getType(), 1, Cost.start(saved, folds)))
+              continue;
+            PHINode* new_phi = reduceAddrRec(A, S, PN, IndVars, preheader_val,
+                                             head_builder, preheader_builder, AR.DT);
+            AddrLeaders.push_back({&A, new_phi});
+            R.Phis.push_back({new_phi, S.toBytes(A.Index->Scale * Steps[0]->Offset)});
+            new_val = new_phi;
           }
+          A.GEP->replaceAllUsesWith(new_val);
+          Dead.insert(A.GEP);
         }
 
-        // modify the new body block by inserting cheaper computation
-        for (auto &indvar : IndVarMap) {
-          tuple<Value*, int, int> t = indvar.second;
-          if (PhiMap.count(indvar.first) && (get<1>(t) != 1 || get<2>(t) != 0)) { // not a basic indvar
-            for (auto &I : *b_body) {
-              if (auto op = dyn_cast<BinaryOperator>(&I)) {
-                Value *lhs = op->getOperand(0);
-                Value *rhs = op->getOperand(1);
-                if (lhs == get<0>(t) || rhs == get<0>(t)) {
-                  IRBuilder<> body_builder(&I);
-                  tuple<Value*, int, int> t_basic = IndVarMap[&I];
-                  int new_val = get<1>(t) * get<2>(t_basic);
-                  PHINode* phi_val = PhiMap[indvar.first];
-                  Value* new_incoming = body_builder.CreateAdd(phi_val, 
-                      ConstantInt::getSigned(phi_val->getType(), new_val));
-                  phi_val->addIncoming(new_incoming, b_body);
-                }
-              }
+        // floating point indvars next, so an integer indvar that was only
+        // converted goes away with them
+        for (auto &F : reverse(FPIndVars)) {
+          Value* V = F.first;
+          FPIndVar &r = F.second;
+          if (r.Int->Basic != PN) continue;
+          if (isDeadAfterRewrite(V, Dead)) {
+            Dead.insert(V);
+            continue;
+          }
+          // a conversion on its own rounds each value once, where the sums
+          // of a phi would round on every step, and nothing allowed that
+          if (V == r.Conv) continue;
+          bool is_signed = r.Conv->getOpcode() == Instruction::SIToFP;
+          if (!all_of(Steps, [&](IndVar* step) { return is_signed ? step->NSW : step->NUW; }) ||
+              !isFPErrorBounded(L, V->getType(), AR.SE) ||
+              !Cost.takePhi(Cost.recompute(r), V->getType(), 1,
+                            Cost.start(Cost.recompute(r),
+                                       const_start && !r.Int->Inv &&
+                                       (!r.Scale || isa<Constant>(r.Scale)) &&
+                                       (!r.Offset || isa<Constant>(r.Offset)))))
+            continue;
+          PHINode* new_phi = reduceFPIndVar(r, PN, IndVars, preheader_val,
+                                            head_builder, preheader_builder);
+          V->replaceAllUsesWith(new_phi);
+          Dead.insert(V);
+        }
+
+        // divisions and remainders by constants become counters, and the
+        // indvars they divided may die with them
+        reduceDivRems(L, PN, Steps, IndVars, preheader_val, head_builder,
+                      preheader_builder, AR.SE, Cost, Dead);
+
+        // derived indvars are visited users first, so one whose only
+        // users are gone already is skipped, and is gone itself; those with
+        // the same scale move in lockstep, so only the first one gets a phi
+        // and its increments, and the others are that phi plus a constant;
+        // the basic indvar leads those of scale one, which already are it
+        // plus a constant and are left as they are
+        SmallVector<std::pair<IndVar*, PHINode*>, 4> Leaders;
+        IndVar* basic = IndVars.lookup(PN);
+        for (IndVar* t : reverse(IndVars)) {
+          // the steps themselves drive every new phi, so they stay put
+          if (t->Basic != PN || t->isBasic() || is_contained(Steps, t)) continue;
+          if (isDeadAfterRewrite(t->V, Dead)) {
+            Dead.insert(t->V);
+            continue;
+          }
+          if (t->isOffsetOf(*basic)) continue;
+          auto Leader = find_if(Leaders, [&](const std::pair<IndVar*, PHINode*> &P) {
+            return P.first->isOffsetOf(*t);
+          });
+          if (Leader != Leaders.end()) {
+            APInt delta = t->Offset - Leader->first->Offset;
+            Value* new_val = Leader->second;
+            if (!delta.isZero()) {
+              IRBuilder<> use_builder(cast<Instruction>(t->V));
+              new_val = use_builder.CreateAdd(new_val,
+                  ConstantInt::get(new_val->getType(), delta));
             }
+            t->V->replaceAllUsesWith(new_val);
+            Dead.insert(t->V);
+            continue;
+          }
+          if (!Cost.takePhi(Cost.recompute(t), t->V->getType(), 1,
+                            Cost.start(t, preheader_val), t->multiplies())) {
+            Cost.decline(t->V);
+            continue;
           }
+          // calculate the new indvar according to the preheader value
+          Value* new_incoming = expandIndVar(preheader_builder, t, preheader_val);
+          PHINode* new_phi = head_builder.CreatePHI(preheader_val->getType(),
+                                                    PN->getNumIncomingValues());
+          // the new indvar advances by scale * step wherever the basic one
+          // takes a step; when both the indvar and the basic step were
+          // exact, and the indvar is computed on every iteration that
+          // reaches the latch, consecutive values are exact too and the
+          // increment keeps the no-wrap flags
+          BasicBlock* t_block = cast<Instruction>(t->V)->getParent();
+          addIncomings(new_phi, PN, b_preheader, new_incoming, IndVars,
+                       [&](IRBuilder<> &body_builder, IndVar* step) {
+            bool sov, uov;
+            APInt new_val = t->Scale.smul_ov(step->Offset, sov);
+            (void)t->Scale.umul_ov(step->Offset, uov);
+            bool every_iter = AR.DT.dominates(t_block, body_builder.GetInsertBlock());
+            return body_builder.CreateAdd(new_phi,
+              ConstantInt::get(new_phi->getType(), new_val), "",
+              every_iter && t->NUW && step->NUW && !uov,
+              every_iter && t->NSW && step->NSW && !sov);
+          });
+          // replace all the original uses with phi-node
+          t->V->replaceAllUsesWith(new_phi);
+          Dead.insert(t->V);
+          Leaders.push_back({t, new_phi});
+          R.Phis.push_back({new_phi, t->Scale * Steps[0]->Offset});
+        }
+        if (same_step && !R.Phis.empty()) Reduced.push_back(std::move(R));
+      }
+
+      // whatever the table could not express is left to scalar evolution
+      bool changed = reduceAddRecs(L, AR, Dead, Cost);
+      changed |= !Dead.empty();
+
+      // the basic indvars that now only count iterations can go too
+      Phase.emplace("exit-tests", "SR exit test replacement");
+      SmallVector<WeakTrackingVH, 16> DeadInsts(Dead.begin(), Dead.end());
+      unsigned exit_tests = 0;
+      for (ReducedIndVar &R : Reduced)
+        exit_tests += replaceExitTests(L, R, AR.SE, Dead, DeadInsts);
+
+      // delete what the rewrite left behind, and then the phi cycles of
+      // the basic indvars nothing uses any more
+      Phase.emplace("cleanup", "SR cleanup");
+      unsigned muls = 0, divs = 0;
+      SmallVector<WeakVH, 8> Phis;
+      for (PHINode &PN : b_header->phis()) Phis.push_back(&PN);
+      RecursivelyDeleteTriviallyDeadInstructionsPermissive(
+          DeadInsts, nullptr, nullptr, [&](Value* V) {
+            switch (cast<Instruction>(V)->getOpcode()) {
+            case Instruction::Mul: case Instruction::Shl: case Instruction::FMul:
+              ++muls;
+              break;
+            case Instruction::UDiv: case Instruction::SDiv:
+            case Instruction::URem: case Instruction::SRem:
+              ++divs;
+              break;
+            }
+          });
+      for (WeakVH &PN : Phis)
+        if (auto *P = dyn_cast_or_null<PHINode>(PN)) RecursivelyDeleteDeadPHINode(P);
+      Phase.reset();
+
+      // the new phis are the header phis that were not there before, and
+      // the old ones that are gone were basic indvars
+      unsigned new_phis = 0, basics = OrigPhis.size();
+      for (PHINode &PN : b_header->phis()) {
+        if (OrigPhis.count(&PN)) --basics;
+        else ++new_phis;
+      }
+      NumPhis += new_phis;
+      NumMulsRemoved += muls;
+      NumDivsRemoved += divs;
+      NumExitTests += exit_tests;
+      NumBasicRemoved += basics;
+
+      if (!any_basic) {
+        ++NumNoIndVar;
+        ORE.emit([&]() {
+          return OptimizationRemarkMissed(DEBUG_TYPE, "NoInductionVariable",
+                                          L->getStartLoc(), L->getHeader())
+                 << "loop not strength reduced: no header phi advances by a "
+                    "constant step";
+        });
+      } else if (changed) {
+        ORE.emit([&]() {
+          return OptimizationRemark(DEBUG_TYPE, "StrengthReduced",
+                                    L->getStartLoc(), L->getHeader())
+                 << "strength reduced loop: inserted "
+                 << ore::NV("NewPhis", new_phis) << " phi nodes; removed "
+                 << ore::NV("Multiplies", muls) << " multiplies, "
+                 << ore::NV("Divisions", divs) << " divisions and "
+                 << ore::NV("BasicIndVars", basics)
+                 << " basic induction variables; replaced "
+                 << ore::NV("ExitTests", exit_tests) << " exit tests";
+        });
+      }
+      if (Cost.rejected()) {
+        ORE.emit([&]() {
+          return OptimizationRemarkMissed(DEBUG_TYPE, "NotProfitable",
+                                          L->getStartLoc(), L->getHeader())
+                 << "cost model turned down " << ore::NV("Rejected", Cost.rejected())
+                 << " phi nodes";
+        });
+      }
+      return changed;
+    } // finish processing the loop
+
+    // whether user U of a basic indvar goes away with the rewrite
+    static bool isDeadUser(User* U, const SmallPtrSetImpl<Value*> &Dead) {
+      if (Dead.count(U)) return true;
+      auto *I = dyn_cast<Instruction>(U);
+      return I && wouldInstructionBeTriviallyDead(I) && isDeadAfterRewrite(I, Dead);
+    }
+
+    // the increments of a new phi may carry nsw/nuw or be inbounds, as
+    // every value the phi takes inside the loop is exact; the one on the
+    // exiting iteration is not used for anything but the exit test, so
+    // may be poison, which a test of it must not branch on
+    static void dropIncrementFlags(Value* V, BasicBlock* b_header) {
+      auto *I = dyn_cast<Instruction>(V);
+      if (!I) return;
+      if (auto *Merge = dyn_cast<PHINode>(I)) {
+        if (Merge->getParent() == b_header) return;
+        for (Value* In : Merge->incoming_values()) dropIncrementFlags(In, b_header);
+        return;
+      }
+      I->dropPoisonGeneratingFlags();
+      if (isa<BitCastInst>(I)) dropIncrementFlags(I->getOperand(0), b_header);
+    }
+
+    // linear function test replacement: a basic indvar whose derived
+    // indvars all have their own phis often only lives on for the exit
+    // tests, so rewrite those as a test of one of the new phis against
+    // its value on the exiting iteration, which follows from the exit
+    // count, and let the basic indvar die; returns the number of tests
+    // replaced
+    unsigned replaceExitTests(Loop* L, const ReducedIndVar &R, ScalarEvolution &SE,
+                          const SmallPtrSetImpl<Value*> &Dead,
+                          SmallVectorImpl<WeakTrackingVH> &DeadInsts) {
+      // the basic indvar and its steps may only feed each other, dead
+      // values, and compares against an invariant that decide an exit
+      SmallVector<Value*, 4> Values{R.Basic};
+      for (IndVar* step : R.Steps) Values.push_back(step->V);
+      // and so may the values a step is built from in more than one add,
+      // such as i + 1 in i + 1 + 1, which keep no phi of their own
+      for (size_t k = 1; k < Values.size(); ++k)
+        for (Value* Op : cast<Instruction>(Values[k])->operands())
+          if (isa<BinaryOperator>(Op) && L->contains(cast<Instruction>(Op)) &&
+              !is_contained(Values, Op))
+            Values.push_back(Op);
+      SmallVector<ICmpInst*, 2> Tests;
+      for (Value* V : Values) {
+        for (User* U : V->users()) {
+          if (is_contained(Values, U) || isDeadUser(U, Dead)) continue;
+          auto *Cmp = dyn_cast<ICmpInst>(U);
+          if (!Cmp || !Cmp->hasOneUse() ||
+              !L->isLoopInvariant(Cmp->getOperand(Cmp->getOperand(0) == V ? 1 : 0)))
+            return 0;
+          auto *BI = dyn_cast<BranchInst>(Cmp->user_back());
+          if (!BI || BI->getParent() != Cmp->getParent() || !L->isLoopExiting(BI->getParent()))
+            return 0;
+          if (!is_contained(Tests, Cmp)) Tests.push_back(Cmp);
+        }
+      }
+
+      // on the iteration an exit is taken, a new phi and its increments
+      // hold start + stride * count; stepping through all the iterations
+      // up to there must not come back to the same value, or the test
+      // would fire early
+      struct ExitTest { ICmpInst* Cmp; Value* V; const SCEV* Limit; };
+      SmallVector<ExitTest, 2> Plan;
+      BasicBlock* b_preheader = L->getLoopPreheader();
+      const DataLayout &DL = b_preheader->getModule()->getDataLayout();
+      Instruction* insert_pos = b_preheader->getTerminator();
+      for (ICmpInst* Cmp : Tests) {
+        BasicBlock* E = Cmp->getParent();
+        const SCEV* EC = SE.getExitCount(L, E);
+        if (isa<SCEVCouldNotCompute>(EC)) return 0;
+        bool post = L->isLoopLatch(E);
+        const SCEV* Limit = nullptr;
+        Value* V = nullptr;
+        for (auto &P : R.Phis) {
+          PHINode* new_phi = P.first;
+          const APInt &stride = P.second;
+          unsigned width = stride.getBitWidth();
+          if (stride.isZero()) continue;
+          unsigned count_width =
+              std::max(width, EC->getType()->getScalarSizeInBits()) + 1;
+          APInt count = SE.getUnsignedRangeMax(EC).zext(count_width);
+          if (post) ++count;
+          bool ov;
+          APInt span = count.umul_ov(stride.abs().zext(count.getBitWidth()), ov);
+          if (ov || span.getActiveBits() > width) continue;
+          Type* IntTy = new_phi->getType()->isPointerTy()
+                            ? DL.getIndexType(new_phi->getType()) : new_phi->getType();
+          const SCEV* N = SE.getTruncateOrZeroExtend(EC, IntTy);
+          if (post) N = SE.getAddExpr(N, SE.getOne(IntTy));
+          Limit = SE.getAddExpr(SE.getSCEV(new_phi->getIncomingValueForBlock(b_preheader)),
+                                SE.getMulExpr(N, SE.getConstant(stride)));
+          if (!isSafeToExpandAt(Limit, insert_pos, SE)) continue;
+          // in size mode the limit may not cost instructions of its own
+          if (optimizeForSize(L) && !isa<SCEVConstant>(Limit)) continue;
+          V = post ? new_phi->getIncomingValueForBlock(E) : new_phi;
+          break;
+        }
+        if (!V) return 0;
+        Plan.push_back({Cmp, V, Limit});
+      }
+
+      SCEVExpander Rewriter(SE, DL, "lftr");
+      for (ExitTest &T : Plan) {
+        BranchInst* BI = cast<BranchInst>(T.Cmp->user_back());
+        if (L->isLoopLatch(BI->getParent()))
+          dropIncrementFlags(T.V, L->getHeader());
+        Value* limit = Rewriter.expandCodeFor(T.Limit, T.V->getType(), insert_pos);
+        IRBuilder<> exit_builder(BI);
+        BI->setCondition(exit_builder.CreateICmp(
+            L->contains(BI->getSuccessor(0)) ? ICmpInst::ICMP_NE : ICmpInst::ICMP_EQ,
+            T.V, limit));
+        DeadInsts.push_back(T.Cmp);
+      }
+      return Plan.size();
+    }
+
+    // whether {start,+,step} + step can be computed without wrapping, i.e.
+    // extending the sum gives the same as summing the extended operands
+    static bool isIncrementNoWrap(ScalarEvolution &SE,
+                                  const SCEVAddRecExpr* Rec, bool Signed) {
+      Type* Ty = Rec->getType();
+      Type* WideTy = IntegerType::get(Ty->getContext(),
+                                      2 * Ty->getIntegerBitWidth());
+      auto extend = [&](const SCEV* S) {
+        return Signed ? SE.getSignExtendExpr(S, WideTy)
+                      : SE.getZeroExtendExpr(S, WideTy);
+      };
+      const SCEV* Step = Rec->getStepRecurrence(SE);
+      return extend(SE.getAddExpr(Rec, Step)) ==
+             SE.getAddExpr(extend(Rec), extend(Step));
+    }
+
+    // rewrite the multiplies the indvar table could not classify, such as
+    // shifts or i * n with a loop invariant n, by asking scalar evolution
+    // for an affine recurrence {start,+,step} and building it as a phi
+    // node; products of indvars like i * i or i * j are quadratic
+    // recurrences {start,+,step,+,step2}, built as two stacked phis where
+    // the second one is the step of the first (finite differencing)
+    bool reduceAddRecs(Loop* L, LoopStandardAnalysisResults &AR,
+                       SmallPtrSetImpl<Value*> &Dead, ReductionCost &Cost) {
+      ScalarEvolution &SE = AR.SE;
+      BasicBlock* b_preheader = L->getLoopPreheader();
+      BasicBlock* b_header = L->getHeader();
+      Instruction* insert_pos = b_preheader->getTerminator();
+
+      SmallVector<std::pair<Instruction*, const SCEVAddRecExpr*>, 8> Candidates;
+      for (auto* B : L->blocks()) {
+        for (auto &I : *B) {
+          if (I.getOpcode() != Instruction::Mul &&
+              I.getOpcode() != Instruction::Shl) continue;
+          // multiplies already replaced by the table are dead, and those
+          // it turned down would only be turned down again
+          if (Dead.count(&I) || Cost.declined(&I) || L->hasLoopInvariantOperands(&I))
+            continue;
+          if (!SE.isSCEVable(I.getType())) continue;
+          auto *Rec = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(&I));
+          if (!Rec || Rec->getLoop() != L ||
+              !(Rec->isAffine() || Rec->isQuadratic())) continue;
+          if (!all_of(Rec->operands(), [&](const SCEV* Op) {
+                return SE.isLoopInvariant(Op, L) && isSafeToExpandAt(Op, insert_pos, SE);
+              })) continue;
+          Candidates.push_back({&I, Rec});
         }
+      }
+      if (Candidates.empty()) return false;
 
-        // replace all the original uses with phi-node
-        for (auto &phi_val : PhiMap) {
-          (phi_val.first)->replaceAllUsesWith(phi_val.second);
+      // the start and steps are loop invariant, so they are expanded once
+      // in the preheader; walking the candidates backwards lets a multiply
+      // that only fed another candidate die instead of getting a phi
+      SCEVExpander Rewriter(SE, b_header->getModule()->getDataLayout(), "sr");
+      IRBuilder<> head_builder(&b_header->front());
+      bool changed = false;
+      Cost.setStepSites(L->getNumBackEdges());
+      // scalar evolution uniques its expressions, so multiplies with the
+      // same recurrence, like i * n and n * i, share the first one's phi
+      DenseMap<const SCEV*, PHINode*> Phis;
+      for (auto &C : reverse(Candidates)) {
+        Instruction* I = C.first;
+        if (isDeadAfterRewrite(I, Dead)) {
+          Dead.insert(I);
+          continue;
+        }
+        const SCEVAddRecExpr* Rec = C.second;
+        if (PHINode* Existing = Phis.lookup(Rec)) {
+          I->replaceAllUsesWith(Existing);
+          Dead.insert(I);
+          continue;
+        }
+        unsigned num_phis = Rec->getNumOperands() - 1;
+        bool folds = all_of(Rec->operands(), [](const SCEV* Op) {
+          return isa<SCEVConstant>(Op);
+        });
+        if (!Cost.takePhi(Cost.recompute(I), I->getType(), num_phis,
+                          Cost.start(Cost.recompute(I), folds)))
+          continue;
+        Type* Ty = I->getType();
+        // phi k holds {op k,+,...,+,op n-1} and advances by phi k + 1, the
+        // last one by the invariant op n-1
+        SmallVector<Value*, 3> Ops;
+        for (const SCEV* Op : Rec->operands())
+          Ops.push_back(Rewriter.expandCodeFor(Op, Ty, insert_pos));
+        SmallVector<PHINode*, 2> new_phis;
+        for (unsigned k = 0; k != num_phis; ++k)
+          new_phis.push_back(head_builder.CreatePHI(Ty, pred_size(b_header)));
+        for (unsigned k = 0; k != num_phis; ++k) {
+          PHINode* new_phi = new_phis[k];
+          Value* step = k + 1 < num_phis ? new_phis[k + 1] : Ops.back();
+          // only an affine recurrence has a fixed step to prove no-wrap with
+          SmallVector<const SCEV*, 3> ChainOps(Rec->op_begin() + k, Rec->op_end());
+          auto *Chain = cast<SCEVAddRecExpr>(
+              SE.getAddRecExpr(ChainOps, L, SCEV::FlagAnyWrap));
+          bool affine = Chain->isAffine();
+          // the recurrence takes the same step along every backedge, so
+          // each latch gets the same increment
+          SmallDenseMap<BasicBlock*, Value*, 4> Steps;
+          for (BasicBlock* B : predecessors(b_header)) {
+            Value*& new_step = Steps[B];
+            if (!new_step && B == b_preheader) {
+              new_step = Ops[k];
+            } else if (!new_step) {
+              IRBuilder<> body_builder(B->getTerminator());
+              new_step = body_builder.CreateAdd(new_phi, step, "",
+                  affine && isIncrementNoWrap(SE, Chain, false),
+                  affine && isIncrementNoWrap(SE, Chain, true));
+            }
+            new_phi->addIncoming(new_step, B);
+          }
         }
+        I->replaceAllUsesWith(new_phis.front());
+        Dead.insert(I);
+        Phis[Rec] = new_phis.front();
+        changed = true;
+      }
+      return changed;
+    }
+
+    // the id of the loop in the instrumentation and its profile, made of
+    // the function name and the place of the loop in the function's loop
+    // nest, so it is the same in every build of the same code
+    static uint32_t getLoopId(Loop* L, LoopInfo &LI) {
+      auto Preorder = LI.getLoopsInPreorder();
+      unsigned index = find(Preorder, L) - Preorder.begin();
+      return xxHash64((L->getHeader()->getParent()->getName() + "#" +
+                       Twine(index)).str());
+    }
 
-      } // finish all loops
+    // the ids of the loops the -sr-profile profile finds hot: like the
+    // profile summary does for blocks, the most iterated loops that make
+    // up HotCutoff of all the iterations, and any loop that ran as often
+    // as the last of them; none if the profile cannot be read, which is
+    // only warned about, so every loop is then taken to be hot
+    static Optional<DenseSet<uint32_t>> readHotLoops(LLVMContext &Ctx) {
+      // the header and records as rtlib.c writes them
+      struct { char Magic[4]; uint32_t Version, Loops, Reserved; } H;
+      struct {
+        uint32_t Id, Flags;
+        uint64_t Entries, Iterations, MaxTrip;
+        int64_t MinStride, MaxStride;
+      } R;
+      auto Buf = MemoryBuffer::getFile(ProfilePath);
+      if (!Buf) {
+        Ctx.diagnose(DiagnosticInfoPGOProfile(ProfilePath.c_str(),
+                                              Buf.getError().message(), DS_Warning));
+        return None;
+      }
+      StringRef Data = (*Buf)->getBuffer();
+      if (Data.size() >= sizeof(H)) memcpy(&H, Data.data(), sizeof(H));
+      if (Data.size() < sizeof(H) || memcmp(H.Magic, "SRPF", 4) ||
+          H.Version != 1 || Data.size() < sizeof(H) + uint64_t(H.Loops) * sizeof(R)) {
+        Ctx.diagnose(DiagnosticInfoPGOProfile(ProfilePath.c_str(),
+                                              "not a loop profile", DS_Warning));
+        return None;
+      }
 
+      SmallVector<std::pair<uint64_t, uint32_t>, 64> Counts;
+      uint64_t total = 0;
+      for (unsigned i = 0; i != H.Loops; ++i) {
+        memcpy(&R, Data.data() + sizeof(H) + i * sizeof(R), sizeof(R));
+        Counts.push_back({R.Iterations, R.Id});
+        total += R.Iterations;
+      }
+      sort(Counts, [](const std::pair<uint64_t, uint32_t> &A,
+                      const std::pair<uint64_t, uint32_t> &B) {
+        return A.first > B.first;
+      });
+      double need = double(total) * HotCutoff / 1000000;
+      uint64_t sum = 0, last = UINT64_MAX;
+      DenseSet<uint32_t> Hot;
+      for (auto &C : Counts) {
+        if (sum >= need && C.first < last) break;
+        Hot.insert(C.second);
+        sum += C.first;
+        last = C.first;
+      }
+      return Hot;
+    }
 
-      // do another round of optimization
-      FPM.doInitialization();
-      changed = FPM.run(F);
-      FPM.doFinalization();
+    // whether the profile finds the loop too cold to spend phi nodes on:
+    // the -sr-profile profile if there is one, otherwise the frequency of
+    // the header against the PGO profile summary; without either, every
+    // loop counts as hot
+    static bool isColdLoop(Loop &L, LoopAnalysisManager &AM,
+                           LoopStandardAnalysisResults &AR) {
+      if (!HotCutoff) return false;
+      if (!ProfilePath.empty()) {
+        // read once, and safely so when several threads run the pass
+        static const Optional<DenseSet<uint32_t>> Hot =
+            readHotLoops(L.getHeader()->getContext());
+        return Hot && !Hot->count(getLoopId(&L, AR.LI));
+      }
+      Function &F = *L.getHeader()->getParent();
+      Module &M = *F.getParent();
+      if (!M.getProfileSummary(/*IsCS=*/false)) return false;
 
+      // a loop pass cannot compute function or module analyses, so like
+      // the remark emitter, build the ones the pass manager does not have
+      auto &FAMP = AM.getResult<FunctionAnalysisManagerLoopProxy>(L, AR);
+      auto *MAMP = FAMP.getCachedResult<ModuleAnalysisManagerFunctionProxy>(F);
+      ProfileSummaryInfo* PSI =
+          MAMP ? MAMP->getCachedResult<ProfileSummaryAnalysis>(M) : nullptr;
+      Optional<ProfileSummaryInfo> OwnedPSI;
+      if (!PSI) {
+        OwnedPSI.emplace(M);
+        PSI = OwnedPSI.getPointer();
+      }
+      BlockFrequencyInfo* BFI = AR.BFI;
+      std::unique_ptr<BlockFrequencyInfo> OwnedBFI;
+      if (!BFI) {
+        BranchProbabilityInfo BPI(F, AR.LI, &AR.TLI);
+        OwnedBFI = std::make_unique<BlockFrequencyInfo>(F, BPI, AR.LI);
+        BFI = OwnedBFI.get();
+      }
+      return !PSI->isHotBlockNthPercentile(HotCutoff, L.getHeader(), BFI);
+    }
+
+    // the instrumentation mode: report every entry to the loop, every
+    // iteration and the step its basic indvar takes to the runtime in
+    // rtlib.c under the loop's id, which is in the remark for the loop
+    static bool instrumentLoop(Loop* L, LoopInfo &LI,
+                               OptimizationRemarkEmitter &ORE) {
+      BasicBlock* b_preheader = L->getLoopPreheader();
+      if (!b_preheader) return false;
+      BasicBlock* b_header = L->getHeader();
+      Function* F = b_header->getParent();
+      Module* M = F->getParent();
+      Type* VoidTy = Type::getVoidTy(M->getContext());
+      IntegerType* IdTy = Type::getInt32Ty(M->getContext());
+      IntegerType* StrideTy = Type::getInt64Ty(M->getContext());
+      FunctionCallee logentry = M->getOrInsertFunction("logentry", VoidTy, IdTy);
+      FunctionCallee logop = M->getOrInsertFunction("logop", VoidTy, IdTy);
+      FunctionCallee logstride =
+          M->getOrInsertFunction("logstride", VoidTy, IdTy, StrideTy);
+
+      uint32_t id = getLoopId(L, LI);
+      Constant* loop_id = ConstantInt::get(IdTy, id);
+
+      IRBuilder<> preheader_builder(b_preheader->getTerminator());
+      preheader_builder.CreateCall(logentry, loop_id);
+      IRBuilder<> head_builder(&*b_header->getFirstInsertionPt());
+      head_builder.CreateCall(logop, loop_id);
+
+      // the stride is the step of the first integer header phi that the
+      // latch adds something to, constant or not; vector phis, and with
+      // them their steps, have no single stride to log
+      if (BasicBlock* b_latch = L->getLoopLatch()) {
+        for (PHINode &PN : b_header->phis()) {
+          if (!PN.getType()->isIntegerTy()) continue;
+          auto *Inc = dyn_cast<BinaryOperator>(PN.getIncomingValueForBlock(b_latch));
+          if (!Inc || Inc->getOpcode() != Instruction::Add ||
+              !is_contained(Inc->operands(), &PN))
+            continue;
+          Value* step = Inc->getOperand(Inc->getOperand(0) == &PN ? 1 : 0);
+          IRBuilder<> latch_builder(b_latch->getTerminator());
+          latch_builder.CreateCall(logstride,
+              {loop_id, latch_builder.CreateSExtOrTrunc(step, StrideTy)});
+          break;
+        }
+      }
+
+      ++NumInstrumented;
+      ORE.emit([&]() {
+        return OptimizationRemarkAnalysis(DEBUG_TYPE, "Instrumented",
+                                          L->getStartLoc(), b_header)
+               << "instrumented loop as " << ore::NV("LoopID", utohexstr(id));
+      });
       return true;
-    } // finish processing loops
+    }
+
+    PreservedAnalyses run(Loop &L, LoopAnalysisManager &AM,
+                          LoopStandardAnalysisResults &AR, LPMUpdater &U) {
+      // like the other loop passes, build the remark emitter on the spot,
+      // as the function analyses cannot be computed from a loop pass
+      OptimizationRemarkEmitter ORE(L.getHeader()->getParent());
+      if (!Instrument && isColdLoop(L, AM, AR)) {
+        ++NumCold;
+        ORE.emit([&]() {
+          return OptimizationRemarkMissed(DEBUG_TYPE, "Cold", L.getStartLoc(),
+                                          L.getHeader())
+                 << "loop not strength reduced: the profile finds it cold";
+        });
+        return PreservedAnalyses::all();
+      }
+      bool changed = Instrument ? instrumentLoop(&L, AR.LI, ORE)
+                                : reduceLoop(&L, AR, ORE);
+      if (!changed)
+        return PreservedAnalyses::all();
+
+      // the replaced indvars may still be cached by scalar evolution; the
+      // control flow is untouched, so everything else stays valid
+      AR.SE.forgetLoop(&L);
+      PreservedAnalyses PA = getLoopPassPreservedAnalyses();
+      PA.preserveSet<CFGAnalyses>();
+      return PA;
+    }
   };
 }
 
-char SkeletonPass::ID = 0;
-static RegisterPass<SkeletonPass> X("sr", "Stregth Reduction Pass",
-                                    false /* Only looks at CFG */,
-                                    true /* Not Analysis Pass */);
-
-// Automatically enable the pass.
-// http://adriansampson.net/blog/clangpass.html
-static void registerSkeletonPass(const PassManagerBuilder &,
-                         legacy::PassManagerBase &PM) {
-  PM.add(new SkeletonPass());
+// Register the pass as "sr" for -passes='loop(sr)', and run it
+// automatically at the end of the loop optimizer pipeline.
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "SkeletonPass", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            PB.registerPipelineParsingCallback(
+                [](StringRef Name, LoopPassManager &LPM,
+                   ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name != "sr") return false;
+                  LPM.addPass(SkeletonPass());
+                  return true;
+                });
+            PB.registerLoopOptimizerEndEPCallback(
+                [](LoopPassManager &LPM, OptimizationLevel) {
+                  LPM.addPass(SkeletonPass());
+                });
+          }};
 }
-static RegisterStandardPasses
-  RegisterMyPass(PassManagerBuilder::EP_LoopOptimizerEnd,
-                 registerSkeletonPass);
@@ -0,0 +1,67 @@
+; RUN: %opt-sr -passes='loop(sr)' -S %s | FileCheck %s
+
+; i * n and n * i are the same recurrence {0,+,n}, so they share a phi
+
+; CHECK-LABEL: @same_recurrence(
+; CHECK: loop:
+; CHECK-NEXT: [[T:%.*]] = phi i32 [ [[T_NEXT:%.*]], %loop ], [ 0, %entry ]
+; CHECK-NEXT: %i = phi
+; CHECK-NOT: phi
+; CHECK: store volatile i32 [[T]], i32* %p
+; CHECK-NEXT: store volatile i32 [[T]], i32* %q
+; CHECK: [[T_NEXT]] = add i32 [[T]], %n
+; CHECK-NOT: add i32 {{.*}}, %n
+define void @same_recurrence(i32* %p, i32* %q, i32 %n, i32 %m) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %a = mul i32 %i, %n
+  store volatile i32 %a, i32* %p
+  %b = mul i32 %n, %i
+  store volatile i32 %b, i32* %q
+  %i.next = add nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %m
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
+
+; the same in the outer loop of a nest, where both rows are {0,+,n}
+
+; CHECK-LABEL: @nest(
+; CHECK: outer:
+; CHECK-NEXT: [[ROW:%.*]] = phi i32 [ [[ROW_NEXT:%.*]], %outer.latch ], [ 0, %entry ]
+; CHECK-NEXT: %i = phi
+; CHECK-NEXT: br label %inner
+; CHECK: %idx = add i32 [[ROW]], %j
+; CHECK: %idx2 = add i32 [[ROW]], %j
+; CHECK: outer.latch:
+; CHECK: [[ROW_NEXT]] = add i32 [[ROW]], %n
+; CHECK-NOT: add i32 {{.*}}, %n
+define void @nest(i32* %a, i32* %b, i32 %n) {
+entry:
+  br label %outer
+outer:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %outer.latch ]
+  br label %inner
+inner:
+  %j = phi i32 [ 0, %outer ], [ %j.next, %inner ]
+  %row = mul i32 %i, %n
+  %idx = add i32 %row, %j
+  %p = getelementptr i32, i32* %a, i32 %idx
+  store i32 %j, i32* %p
+  %row2 = mul i32 %i, %n
+  %idx2 = add i32 %row2, %j
+  %q = getelementptr i32, i32* %b, i32 %idx2
+  store i32 %j, i32* %q
+  %j.next = add i32 %j, 1
+  %jc = icmp slt i32 %j.next, %n
+  br i1 %jc, label %inner, label %outer.latch
+outer.latch:
+  %i.next = add i32 %i, 1
+  %ic = icmp slt i32 %i.next, 10
+  br i1 %ic, label %outer, label %exit
+exit:
+  ret void
+}
@@ -0,0 +1,109 @@
+; RUN: %opt-sr -passes='loop(sr)' -S %s | FileCheck %s
+
+; i / 4 and i % 4 of a signed indvar that starts at zero and never wraps
+; become a quotient and a remainder counter: the remainder steps by one
+; and wraps around at 4, carrying one into the quotient
+
+; CHECK-LABEL: @counters(
+; CHECK: loop:
+; CHECK-NEXT: [[R:%.*]] = phi i32 [ 0, %entry ], [ [[R_NEXT:%.*]], %loop ]
+; CHECK-NEXT: [[Q:%.*]] = phi i32 [ 0, %entry ], [ [[Q_NEXT:%.*]], %loop ]
+; CHECK-NOT: sdiv
+; CHECK-NOT: srem
+; CHECK: store volatile i32 [[Q]], i32* %p
+; CHECK-NEXT: store volatile i32 [[R]], i32* %p
+; CHECK: [[R_STEP:%.*]] = add nuw i32 [[R]], 1
+; CHECK-NEXT: [[CARRY:%.*]] = icmp uge i32 [[R_STEP]], 4
+; CHECK-NEXT: [[R_WRAP:%.*]] = sub nuw i32 [[R_STEP]], 4
+; CHECK-NEXT: [[R_NEXT]] = select i1 [[CARRY]], i32 [[R_WRAP]], i32 [[R_STEP]]
+; CHECK-NEXT: [[C:%.*]] = zext i1 [[CARRY]] to i32
+; CHECK-NEXT: [[Q_NEXT]] = add nuw i32 [[Q]], [[C]]
+define void @counters(i32* %p, i32 %n) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %q = sdiv i32 %i, 4
+  store volatile i32 %q, i32* %p
+  %r = srem i32 %i, 4
+  store volatile i32 %r, i32* %p
+  %i.next = add nuw nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
+
+; unsigned by a power of two they are a shift and a mask already, cheaper
+; than the counters
+
+; CHECK-LABEL: @shift_and_mask(
+; CHECK: loop:
+; CHECK-NEXT: %i = phi
+; CHECK-NOT: phi
+; CHECK: %q = udiv i32 %i, 4
+; CHECK: %r = urem i32 %i, 4
+define void @shift_and_mask(i32* %p, i32 %n) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %q = udiv i32 %i, 4
+  store volatile i32 %q, i32* %p
+  %r = urem i32 %i, 4
+  store volatile i32 %r, i32* %p
+  %i.next = add nuw nsw i32 %i, 1
+  %c = icmp ult i32 %i.next, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
+
+; a divisor that is not a constant gives no fixed wrap-around point
+
+; CHECK-LABEL: @variable_divisor(
+; CHECK: loop:
+; CHECK-NEXT: %i = phi
+; CHECK-NOT: phi
+; CHECK: %q = sdiv i32 %i, %d
+; CHECK: %r = srem i32 %i, %d
+define void @variable_divisor(i32* %p, i32 %n, i32 %d) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %q = sdiv i32 %i, %d
+  store volatile i32 %q, i32* %p
+  %r = srem i32 %i, %d
+  store volatile i32 %r, i32* %p
+  %i.next = add nuw nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
+
+; an indvar that may wrap past the signed maximum would turn negative,
+; where the counters would keep on counting up
+
+; CHECK-LABEL: @may_wrap(
+; CHECK: loop:
+; CHECK-NEXT: %i = phi
+; CHECK-NOT: phi
+; CHECK: %q = sdiv i32 %i, 4
+; CHECK: %r = srem i32 %i, 4
+define void @may_wrap(i32* %p, i32 %n) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %q = sdiv i32 %i, 4
+  store volatile i32 %q, i32* %p
+  %r = srem i32 %i, 4
+  store volatile i32 %r, i32* %p
+  %i.next = add i32 %i, 1
+  %c = icmp ne i32 %i.next, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
@@ -0,0 +1,79 @@
+; RUN: %opt-sr -passes='loop(sr)' -S %s | FileCheck %s
+
+; under reassoc, float(i) * 0.5 + 3.0 becomes a float phi that starts at
+; its value for the first i and adds 0.5 per iteration
+
+; CHECK-LABEL: @scaled(
+; CHECK: entry:
+; CHECK-NEXT: [[F:%.*]] = sitofp i32 %s to float
+; CHECK-NEXT: [[G:%.*]] = fmul reassoc float [[F]], 5.000000e-01
+; CHECK-NEXT: [[H:%.*]] = fadd reassoc float [[G]], 3.000000e+00
+; CHECK: loop:
+; CHECK-NEXT: [[X:%.*]] = phi float [ [[H]], %entry ], [ [[X_NEXT:%.*]], %loop ]
+; CHECK: store volatile float [[X]], float* %p
+; CHECK: [[X_NEXT]] = fadd reassoc float [[X]], 5.000000e-01
+define void @scaled(float* %p, i32 %s, i32 %n) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ %s, %entry ], [ %i.next, %loop ]
+  %f = sitofp i32 %i to float
+  %g = fmul reassoc float %f, 5.000000e-01
+  %h = fadd reassoc float %g, 3.000000e+00
+  store volatile float %h, float* %p
+  %i.next = add nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
+
+; * 2.0 * 0.5 is a scale of one and + 0.0 under nsz an offset of nothing,
+; so the phi starts at float(s) itself
+
+; CHECK-LABEL: @identities(
+; CHECK: entry:
+; CHECK-NEXT: [[F:%.*]] = sitofp i32 %s to float
+; CHECK-NEXT: br label %loop
+; CHECK: loop:
+; CHECK-NEXT: [[X:%.*]] = phi float [ [[F]], %entry ], [ [[X_NEXT:%.*]], %loop ]
+; CHECK-NOT: fmul
+; CHECK: [[X_NEXT]] = fadd reassoc float [[X]], 1.000000e+00
+define void @identities(float* %p, i32 %s, i32 %n) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ %s, %entry ], [ %i.next, %loop ]
+  %f = sitofp i32 %i to float
+  %a = fmul reassoc float %f, 2.000000e+00
+  %b = fmul reassoc float %a, 5.000000e-01
+  %d = fadd reassoc nsz float %b, 0.000000e+00
+  store volatile float %d, float* %p
+  %i.next = add nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
+
+; without reassoc the sums would round differently, so nothing changes
+
+; CHECK-LABEL: @strict(
+; CHECK: loop:
+; CHECK-NEXT: %i = phi
+; CHECK-NOT: phi
+; CHECK: %g = fmul float %f, 5.000000e-01
+define void @strict(float* %p, i32 %s, i32 %n) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ %s, %entry ], [ %i.next, %loop ]
+  %f = sitofp i32 %i to float
+  %g = fmul float %f, 5.000000e-01
+  store volatile float %g, float* %p
+  %i.next = add nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
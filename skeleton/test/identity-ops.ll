@@ -0,0 +1,75 @@
+; RUN: %opt-sr -passes='loop(sr)' -S %s | FileCheck %s
+
+; the start values of the new phis are computed in the preheader without
+; multiplies by one or adds of zero
+
+; CHECK-LABEL: @scaled(
+; CHECK: entry:
+; CHECK-NEXT: [[S5:%.*]] = mul i32 %s, 5
+; CHECK-NEXT: [[K5:%.*]] = mul i32 %k, 5
+; CHECK-NEXT: [[B0:%.*]] = add i32 [[S5]], [[K5]]
+; CHECK-NEXT: [[S3:%.*]] = mul i32 %s, 3
+; CHECK-NEXT: br label %loop
+; CHECK: phi i32 [ [[B0]], %entry ]
+; CHECK: phi i32 [ [[S3]], %entry ]
+define void @scaled(i32* %p, i32 %s, i32 %n, i32 %k) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ %s, %entry ], [ %i.next, %loop ]
+  %m = mul nsw i32 %i, 3
+  store volatile i32 %m, i32* %p
+  %ik = add nsw i32 %i, %k
+  %b = mul nsw i32 %ik, 5
+  store volatile i32 %b, i32* %p
+  %i.next = add nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
+
+; from a start of zero the phi of (i + k) * 5 starts at k * 5 alone
+
+; CHECK-LABEL: @from_zero(
+; CHECK: entry:
+; CHECK-NEXT: [[K5:%.*]] = mul i32 %k, 5
+; CHECK-NEXT: br label %loop
+; CHECK: phi i32 [ [[K5]], %entry ]
+define void @from_zero(i32* %p, i32 %n, i32 %k) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %ik = add nsw i32 %i, %k
+  %b = mul nsw i32 %ik, 5
+  store volatile i32 %b, i32* %p
+  %i.next = add nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
+
+; the address a[i + k] starts at a[s + k], with no multiply by one
+
+; CHECK-LABEL: @unscaled_index(
+; CHECK: entry:
+; CHECK-NEXT: [[IDX:%.*]] = add i32 %s, %k
+; CHECK-NEXT: [[EXT:%.*]] = sext i32 [[IDX]] to i64
+; CHECK-NEXT: getelementptr i32, i32* %a, i64 [[EXT]]
+define void @unscaled_index(i32* %a, i32 %s, i32 %n, i32 %k) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ %s, %entry ], [ %i.next, %loop ]
+  %ik = add nsw i32 %i, %k
+  %idx = sext i32 %ik to i64
+  %q = getelementptr inbounds i32, i32* %a, i64 %idx
+  store volatile i32 0, i32* %q
+  %i.next = add nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
@@ -0,0 +1,27 @@
+; RUN: %opt-sr -passes='loop(sr)' -sr-instrument -S %s | FileCheck %s
+; RUN: %opt-sr -passes='loop(sr)' -sr-instrument -S %s | opt -passes=verify -disable-output
+
+; with -sr-instrument the stride logged is the step of the scalar indvar
+; i, not that of the vector induction before it, which has no single
+; stride to log
+
+; CHECK-LABEL: @vec(
+; CHECK: call void @logentry(i32 [[ID:-?[0-9]+]])
+; CHECK: loop:
+; CHECK: call void @logop(i32 [[ID]])
+; CHECK-NOT: <4 x i32> {{.*}} to i64
+; CHECK: call void @logstride(i32 [[ID]], i64 1)
+define void @vec(<4 x i32>* %p, i64 %n) {
+entry:
+  br label %loop
+loop:
+  %v = phi <4 x i32> [ <i32 0, i32 1, i32 2, i32 3>, %entry ], [ %v.next, %loop ]
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  store volatile <4 x i32> %v, <4 x i32>* %p
+  %v.next = add <4 x i32> %v, <i32 4, i32 4, i32 4, i32 4>
+  %i.next = add nsw i64 %i, 1
+  %c = icmp slt i64 %i.next, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
@@ -0,0 +1,54 @@
+; RUN: %opt-sr -passes='loop(sr)' -S %s | FileCheck %s
+; RUN: %opt-sr -passes='loop(sr),instcombine' -S %s | FileCheck %s --check-prefix=FOLD
+
+; after the exit test is replaced, the increment it compares is the value
+; for one iteration past the end; that one can overflow, so it must not
+; keep the no-wrap flags or inbounds, or the test branches on poison
+
+@arr = global [2 x i32] zeroinitializer
+
+; 0, 64 and then 128, which wraps in i8
+; CHECK-LABEL: @narrow(
+; CHECK: [[T:%.*]] = phi i8 [ 0, %entry ], [ [[T_NEXT:%.*]], %loop ]
+; CHECK: [[T_NEXT]] = add i8 [[T]], 64
+; CHECK-NEXT: [[C:%.*]] = icmp ne i8 [[T_NEXT]], -128
+; CHECK-NEXT: br i1 [[C]], label %loop, label %exit
+; FOLD-LABEL: @narrow(
+; FOLD: [[C:%.*]] = icmp eq i8 {{%.*}}, -128
+; FOLD-NEXT: br i1 [[C]], label %exit, label %loop
+define void @narrow(i8* %p) {
+entry:
+  br label %loop
+loop:
+  %i = phi i8 [ 0, %entry ], [ %i.next, %loop ]
+  %t = mul nsw i8 %i, 64
+  store volatile i8 %t, i8* %p
+  %i.next = add nsw i8 %i, 1
+  %c = icmp slt i8 %i.next, 2
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
+
+; a walk down from arr[1] ends at arr[-1], which is outside of @arr
+; CHECK-LABEL: @down(
+; CHECK: [[P:%.*]] = phi i32* [ getelementptr inbounds ([2 x i32], [2 x i32]* @arr, i64 0, i64 1), %entry ]
+; CHECK: [[RAW:%.*]] = bitcast i32* [[P]] to i8*
+; CHECK-NEXT: [[NEXT:%.*]] = getelementptr i8, i8* [[RAW]], i64 -4
+; CHECK: icmp ne i32*
+; FOLD-LABEL: @down(
+; FOLD: [[C:%.*]] = icmp eq i32* {{%.*}}, getelementptr ([2 x i32], [2 x i32]* @arr, i64 -1, i64 1)
+; FOLD-NEXT: br i1 [[C]], label %exit, label %loop
+define void @down() {
+entry:
+  br label %loop
+loop:
+  %i = phi i64 [ 1, %entry ], [ %i.next, %loop ]
+  %a = getelementptr inbounds [2 x i32], [2 x i32]* @arr, i64 0, i64 %i
+  store volatile i32 0, i32* %a
+  %i.next = add nsw i64 %i, -1
+  %c = icmp sge i64 %i.next, 0
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
@@ -0,0 +1,21 @@
+# lit configuration for the IR tests of the strength reduction pass; the
+# paths come from lit.site.cfg.py, which CMake writes into the build tree
+
+import os
+
+import lit.formats
+
+config.name = 'SkeletonPass'
+config.test_format = lit.formats.ShTest(True)
+config.suffixes = ['.ll']
+config.test_source_root = os.path.dirname(__file__)
+config.test_exec_root = os.path.join(config.obj_root, 'test')
+
+# opt, FileCheck and not from the LLVM the pass was built against
+config.environment['PATH'] = os.pathsep.join(
+    [config.llvm_tools_dir, config.environment.get('PATH', '')])
+
+# the plugin is loaded twice over: -load-pass-plugin for the pass and
+# -load for its options, which only register with the legacy loader
+config.substitutions.append(
+    ('%opt-sr', f'opt -load {config.plugin} -load-pass-plugin {config.plugin}'))
@@ -0,0 +1,25 @@
+; RUN: rm -f %t.prof
+; RUN: %opt-sr -passes='loop(sr)' -sr-profile=%t.prof -S %s 2>&1 | FileCheck %s
+
+; a loop profile that cannot be read is a warning, and without it every
+; loop is hot and still strength reduced
+
+; CHECK: warning: {{.*}}.prof: {{.*}}
+; CHECK-LABEL: @f(
+; CHECK: loop:
+; CHECK-NEXT: [[T:%.*]] = phi i32 [ 0, %entry ]
+; CHECK-NOT: mul
+; CHECK: add i32 [[T]], 3
+define void @f(i32* %p, i32 %n) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %m = mul i32 %i, 3
+  store volatile i32 %m, i32* %p
+  %i.next = add nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
@@ -0,0 +1,35 @@
+; RUN: %opt-sr -passes='loop(sr)' -S %s | FileCheck %s
+
+; i steps by 2 on one latch and by 1 on the other; loop-simplify merges
+; the two backedges into one block, so the phi of i * 3 takes its value
+; from a merge that gets an increment of 6 from the first latch and of 3
+; from the second
+
+; CHECK-LABEL: @two_latches(
+; CHECK: loop:
+; CHECK-NEXT: [[T:%.*]] = phi i32 [ 0, %entry ], [ [[T_BE:%.*]], %loop.backedge ]
+; CHECK-NEXT: %i = phi
+; CHECK-NOT: mul
+; CHECK: store volatile i32 [[T]], i32* %p
+; CHECK: [[T_SKIP:%.*]] = add nsw i32 [[T]], 6
+; CHECK-NEXT: br i1 %skip, label %loop.backedge, label %body
+; CHECK: loop.backedge:
+; CHECK-NEXT: [[T_BE]] = phi i32 [ [[T_NEXT:%.*]], %body ], [ [[T_SKIP]], %loop ]
+; CHECK: body:
+; CHECK: [[T_NEXT]] = add nsw i32 [[T]], 3
+define void @two_latches(i32* %p, i32 %n, i1 %skip) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %body ], [ %i.skip, %loop ]
+  %m = mul nsw i32 %i, 3
+  store volatile i32 %m, i32* %p
+  %i.skip = add nsw i32 %i, 2
+  br i1 %skip, label %loop, label %body
+body:
+  %i.next = add nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
@@ -0,0 +1,42 @@
+; RUN: %opt-sr -passes='loop(sr)' -S %s | FileCheck %s
+
+; the increment of a new phi keeps nsw when the indvar and the step of
+; the basic indvar were both exact
+
+; CHECK-LABEL: @exact(
+; CHECK: loop:
+; CHECK: [[T:%.*]] = phi i32 [ 0, %entry ], [ [[T_NEXT:%.*]], %loop ]
+; CHECK: store volatile i32 [[T]], i32* %p
+; CHECK: [[T_NEXT]] = add nsw i32 [[T]], 3
+define void @exact(i32* %p, i32 %n) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %t = mul nsw i32 %i, 3
+  store volatile i32 %t, i32* %p
+  %i.next = add nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
+
+; a multiply that may wrap gives an increment without flags
+
+; CHECK-LABEL: @wrapping(
+; CHECK: [[T:%.*]] = phi i32 [ 0, %entry ], [ [[T_NEXT:%.*]], %loop ]
+; CHECK: [[T_NEXT]] = add i32 [[T]], 3
+define void @wrapping(i32* %p, i32 %n) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %t = mul i32 %i, 3
+  store volatile i32 %t, i32* %p
+  %i.next = add nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
@@ -0,0 +1,82 @@
+; RUN: %opt-sr -passes='loop(sr)' -S %s | FileCheck %s
+
+; i * i is {0,+,1,+,2}: a phi for the square that adds a second phi for
+; its step, which in turn adds 2
+
+; CHECK-LABEL: @square(
+; CHECK: loop:
+; CHECK-NEXT: [[SQ:%.*]] = phi i32 [ [[SQ_NEXT:%.*]], %loop ], [ 0, %entry ]
+; CHECK-NEXT: [[D:%.*]] = phi i32 [ [[D_NEXT:%.*]], %loop ], [ 1, %entry ]
+; CHECK-NOT: mul
+; CHECK: store volatile i32 [[SQ]], i32* %p
+; CHECK: [[SQ_NEXT]] = add i32 [[SQ]], [[D]]
+; CHECK-NEXT: [[D_NEXT]] = add nuw i32 [[D]], 2
+define void @square(i32* %p, i32 %n) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %sq = mul i32 %i, %i
+  store volatile i32 %sq, i32* %p
+  %i.next = add nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
+
+; i * (i + 3) is {0,+,4,+,2}
+
+; CHECK-LABEL: @product(
+; CHECK: loop:
+; CHECK-NEXT: [[P:%.*]] = phi i32 [ [[P_NEXT:%.*]], %loop ], [ 0, %entry ]
+; CHECK-NEXT: [[D:%.*]] = phi i32 [ [[D_NEXT:%.*]], %loop ], [ 4, %entry ]
+; CHECK-NOT: mul
+; CHECK: store volatile i32 [[P]], i32* %p
+; CHECK: [[P_NEXT]] = add i32 [[P]], [[D]]
+; CHECK-NEXT: [[D_NEXT]] = add i32 [[D]], 2
+define void @product(i32* %p, i32 %n) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %j = add nsw i32 %i, 3
+  %ij = mul i32 %i, %j
+  store volatile i32 %ij, i32* %p
+  %i.next = add nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
+
+; in a nest, i * j is only affine in the inner loop, {0,+,i}, and takes a
+; single phi there
+
+; CHECK-LABEL: @nest(
+; CHECK: inner:
+; CHECK-NEXT: [[IJ:%.*]] = phi i32 [ [[IJ_NEXT:%.*]], %inner ], [ 0, %outer ]
+; CHECK-NEXT: %j = phi
+; CHECK-NOT: phi
+; CHECK: store volatile i32 [[IJ]], i32* %p
+; CHECK: [[IJ_NEXT]] = add i32 [[IJ]], %i
+define void @nest(i32* %p, i32 %n) {
+entry:
+  br label %outer
+outer:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %outer.latch ]
+  br label %inner
+inner:
+  %j = phi i32 [ 0, %outer ], [ %j.next, %inner ]
+  %ij = mul i32 %i, %j
+  store volatile i32 %ij, i32* %p
+  %j.next = add nsw i32 %j, 1
+  %cj = icmp slt i32 %j.next, %n
+  br i1 %cj, label %inner, label %outer.latch
+outer.latch:
+  %i.next = add nsw i32 %i, 1
+  %ci = icmp slt i32 %i.next, %n
+  br i1 %ci, label %outer, label %exit
+exit:
+  ret void
+}
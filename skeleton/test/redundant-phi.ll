@@ -0,0 +1,52 @@
+; RUN: %opt-sr -passes='loop(sr)' -S %s | FileCheck %s
+
+; i + 5 and i + k cost one add either way, and i stays live for the
+; store, so they are left to the basic indvar instead of getting phis
+
+; CHECK-LABEL: @offsets(
+; CHECK: loop:
+; CHECK-NEXT: %i = phi
+; CHECK-NOT: phi
+; CHECK: %a = add nsw i32 %i, 5
+; CHECK: %b = add nsw i32 %i, %k
+define void @offsets(i32* %p, i32* %q, i32 %n, i32 %k) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %a = add nsw i32 %i, 5
+  store volatile i32 %a, i32* %p
+  %b = add nsw i32 %i, %k
+  store volatile i32 %b, i32* %p
+  store volatile i32 %i, i32* %q
+  %i.next = add nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
+
+; i + 1 is only half of the step i + 1 + 1, and goes with it when the
+; exit test moves to the phi of i * 3
+
+; CHECK-LABEL: @split_step(
+; CHECK: loop:
+; CHECK-NEXT: [[T:%.*]] = phi i32 [ 0, %entry ], [ [[T_NEXT:%.*]], %loop ]
+; CHECK-NOT: phi
+; CHECK-NOT: %i1
+; CHECK: [[T_NEXT]] = add i32 [[T]], 6
+; CHECK-NEXT: icmp ne i32 [[T_NEXT]], 30
+define void @split_step(i32* %p) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %m = mul i32 %i, 3
+  store volatile i32 %m, i32* %p
+  %i1 = add i32 %i, 1
+  %i.next = add i32 %i1, 1
+  %c = icmp slt i32 %i.next, 10
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
@@ -0,0 +1,47 @@
+; RUN: %opt-sr -passes='loop(sr)' -pass-remarks-missed=sr -disable-output %s 2>&1 \
+; RUN:   | FileCheck %s
+; RUN: %opt-sr -passes='loop(sr)' -pass-remarks-missed=sr -sr-max-new-phis=0 \
+; RUN:   -disable-output %s 2>&1 | FileCheck %s --check-prefix=BUDGET
+
+; under optsize the phi of i * 3 costs as many instructions as it saves,
+; and a multiply the indvar table turned down is not weighed again as a
+; recurrence, so the remark counts it once
+
+; CHECK: remark: {{.*}} cost model turned down 1 phi nodes
+; CHECK-NOT: turned down
+
+; with no budget for new phis every multiply is turned down exactly once
+
+; BUDGET: remark: {{.*}} cost model turned down 1 phi nodes
+; BUDGET-NEXT: remark: {{.*}} cost model turned down 2 phi nodes
+; BUDGET-NOT: turned down
+
+define void @small(i32* %p, i32 %n) optsize {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %m = mul nsw i32 %i, 3
+  store volatile i32 %m, i32* %p
+  %i.next = add nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
+
+define void @fast(i32* %p, i32 %n) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %m = mul nsw i32 %i, 3
+  store volatile i32 %m, i32* %p
+  %k = mul nsw i32 %i, 5
+  store volatile i32 %k, i32* %p
+  %i.next = add nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
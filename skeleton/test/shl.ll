@@ -0,0 +1,87 @@
+; RUN: %opt-sr -passes='loop(sr)' -S %s | FileCheck %s
+
+; i << 3 is i * 8, so (i << 3) + 5 gets a phi that starts at 5 and adds
+; 8, keeping nsw from the shift
+
+; CHECK-LABEL: @by_constant(
+; CHECK: loop:
+; CHECK-NEXT: [[T:%.*]] = phi i32 [ 5, %entry ], [ [[T_NEXT:%.*]], %loop ]
+; CHECK-NOT: shl
+; CHECK: store volatile i32 [[T]], i32* %p
+; CHECK: [[T_NEXT]] = add nsw i32 [[T]], 8
+define void @by_constant(i32* %p, i32 %n) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %s = shl nsw i32 %i, 3
+  %t = add nsw i32 %s, 5
+  store volatile i32 %t, i32* %p
+  %i.next = add nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
+
+; a shift by the bit width or more is poison, not a multiply
+
+; CHECK-LABEL: @too_far(
+; CHECK: loop:
+; CHECK-NEXT: %i = phi
+; CHECK-NOT: phi
+; CHECK: %s = shl i32 %i, 32
+define void @too_far(i32* %p, i32 %n) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %s = shl i32 %i, 32
+  store volatile i32 %s, i32* %p
+  %i.next = add nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
+
+; shifts by a variable amount, or of a constant by the indvar, are not
+; linear in the indvar and stay as they are
+
+; CHECK-LABEL: @by_variable(
+; CHECK: loop:
+; CHECK-NEXT: %i = phi
+; CHECK-NOT: phi
+; CHECK: %s = shl i32 %i, %k
+define void @by_variable(i32* %p, i32 %n, i32 %k) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %s = shl i32 %i, %k
+  store volatile i32 %s, i32* %p
+  %i.next = add nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
+
+; CHECK-LABEL: @by_indvar(
+; CHECK: loop:
+; CHECK-NEXT: %i = phi
+; CHECK-NOT: phi
+; CHECK: %s = shl i32 1, %i
+define void @by_indvar(i32* %p, i32 %n) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %s = shl i32 1, %i
+  store volatile i32 %s, i32* %p
+  %i.next = add nsw i32 %i, 1
+  %c = icmp slt i32 %i.next, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
@@ -0,0 +1,49 @@
+; RUN: %opt-sr -passes='loop(sr)' -sr-vectorizer-friendly -S %s | FileCheck %s
+; RUN: %opt-sr -passes='loop(sr)' -sr-vectorizer-friendly -pass-remarks-missed=sr \
+; RUN:   -disable-output %s 2>&1 | FileCheck %s --check-prefix=REMARK
+
+; with -sr-vectorizer-friendly the inner loop is left as it is, with
+; row + j, j * 7 and j * n computed from j, and a remark says so, while
+; the outer loop still gets a phi for i * n
+
+; REMARK: remark: {{.*}} loop not strength reduced: innermost loops are left to the loop vectorizer
+; REMARK-NOT: innermost
+
+; CHECK-LABEL: @nest(
+; CHECK: outer:
+; CHECK-NEXT: [[ROW:%.*]] = phi i32
+; CHECK-NEXT: %i = phi
+; CHECK-NOT: phi
+; CHECK: inner:
+; CHECK-NEXT: %j = phi
+; CHECK-NEXT: %rj = add nsw i32 [[ROW]], %j
+; CHECK-NEXT: %j7 = mul nsw i32 %j, 7
+; CHECK-NEXT: %jn = mul nsw i32 %j, %n
+; CHECK-NOT: phi
+; CHECK: outer.latch:
+define void @nest(i32* %a, i32* %p, i32 %n) {
+entry:
+  br label %outer
+outer:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %outer.latch ]
+  %row = mul nsw i32 %i, %n
+  br label %inner
+inner:
+  %j = phi i32 [ 0, %outer ], [ %j.next, %inner ]
+  %rj = add nsw i32 %row, %j
+  %j7 = mul nsw i32 %j, 7
+  %jn = mul nsw i32 %j, %n
+  %idx = sext i32 %rj to i64
+  %q = getelementptr inbounds i32, i32* %a, i64 %idx
+  store i32 %j7, i32* %q
+  store volatile i32 %jn, i32* %p
+  %j.next = add nsw i32 %j, 1
+  %cj = icmp slt i32 %j.next, %n
+  br i1 %cj, label %inner, label %outer.latch
+outer.latch:
+  %i.next = add nsw i32 %i, 1
+  %ci = icmp slt i32 %i.next, %n
+  br i1 %ci, label %outer, label %exit
+exit:
+  ret void
+}
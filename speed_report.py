@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+# measure every embench benchmark on the host, built by sr-driver without
+# and with the sr pass and linked with harness.c: each binary runs the
+# benchmark a number of times, pinned to a cpu and after warming up, and
+# the median and interquartile range of the cycles (or of the time, where
+# the kernel gives no counters) and instructions are reported, with the
+# speedup of sr and its geometric mean over the benchmarks
+# usage: speed_report.py [--build build] [--runs 10] [benchmark ...]
+
+import argparse
+import glob
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+
+# absolute, as the fallback build runs clang in its output directory
+EMBENCH_DIR = os.path.abspath(os.environ.get('EMBENCH_DIR', 'embench-iot'))
+sys.path.insert(0, os.path.join(EMBENCH_DIR, 'pylib'))
+
+from embench_core import compute_geomean, compute_geosd, gp
+
+HARNESS = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                       'harness.c')
+
+# the pipeline of run.sh, and the same without the pass
+PASSES = {
+    'base': 'mem2reg,instsimplify,loop(indvars),dce',
+    'sr': 'mem2reg,instsimplify,loop(indvars,sr),dce',
+}
+
+
+def build(args, bench, variant, tmp):
+    """Build bench with the pipeline of variant in tmp, return the binary."""
+    driver = os.path.join(args.build, 'driver', 'sr-driver')
+    srcdir = os.path.join(EMBENCH_DIR, 'src', bench)
+    support = os.path.join(EMBENCH_DIR, 'support')
+    sources = sorted(glob.glob(os.path.join(srcdir, '*.c')))
+    sources.append(os.path.join(support, 'beebsc.c'))
+    flags = [f'-I{srcdir}', f'-I{support}', f'-DCPU_MHZ={args.cpu_mhz}']
+    outdir = os.path.join(tmp, variant)
+    os.makedirs(outdir)
+
+    cmd = [driver, f'-passes={PASSES[variant]}', '-emit=obj', '-o', outdir,
+           f'-cache-dir={args.cache_dir}']
+    if args.driver_has_clang:
+        subprocess.run(cmd + ['-cflags=' + ','.join(flags)] + sources,
+                       check=True)
+    else:
+        # clang writes its bitcode to the current directory
+        subprocess.run(['clang', '-c', '-emit-llvm', '-O0', '-Xclang',
+                        '-disable-O0-optnone'] + flags + sources,
+                       cwd=outdir, check=True)
+        subprocess.run(cmd + glob.glob(os.path.join(outdir, '*.bc')),
+                       check=True)
+
+    binary = os.path.join(tmp, f'{bench}-{variant}')
+    subprocess.run([args.cc, '-o', binary, args.harness]
+                   + glob.glob(os.path.join(outdir, 'opt_*.o')) + ['-lm'],
+                   check=True)
+    return binary
+
+
+def measure(args, binary):
+    """Run binary, return its cycles (or nanoseconds) and instructions."""
+    out = subprocess.run([binary, str(args.runs), str(args.warmups),
+                          str(args.cpu)],
+                         stdout=subprocess.PIPE, check=True,
+                         universal_newlines=True).stdout
+    cycles, instructions = [], []
+    for line in out.splitlines():
+        c, i, ns, correct = (int(v) for v in line.split())
+        if correct != 1:
+            sys.exit(f'{binary}: wrong result')
+        cycles.append(c if c >= 0 else ns)
+        instructions.append(i)
+    return cycles, instructions
+
+
+def summary(data):
+    """The median and interquartile range of data, None if unmeasured."""
+    if min(data) < 0:
+        return None
+    if len(data) == 1:
+        return data[0], 0
+    q1, median, q3 = statistics.quantiles(data, n=4, method='inclusive')
+    return median, q3 - q1
+
+
+def show(stat):
+    return f'{"-":>22}' if stat is None else f'{stat[0]:13.0f} ±{stat[1]:8.0f}'
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare the speed of the '
+                                     'benchmarks without and with sr')
+    parser.add_argument('--build', default='build',
+                        help='Build directory of the pass and sr-driver')
+    parser.add_argument('--runs', type=int, default=10,
+                        help='Measured runs of each benchmark')
+    parser.add_argument('--warmups', type=int, default=1,
+                        help='Runs before measuring')
+    parser.add_argument('--cpu', type=int, default=0,
+                        help='CPU to pin the benchmarks to, -1 for none')
+    parser.add_argument('--cpu-mhz', type=int, default=1000,
+                        help='CPU_MHZ, which scales the work of a run')
+    parser.add_argument('--cc', default='cc',
+                        help='Host compiler for the harness and linking')
+    parser.add_argument('--cache-dir',
+                        default=os.environ.get('SR_CACHE_DIR', '.sr-cache'),
+                        help='sr-driver cache')
+    parser.add_argument('benchmarks', nargs='*',
+                        help='Benchmarks to measure (default: all)')
+    args = parser.parse_args()
+    usage = subprocess.run([os.path.join(args.build, 'driver', 'sr-driver'),
+                            '--help'], stdout=subprocess.PIPE,
+                           universal_newlines=True).stdout
+    args.driver_has_clang = '-cflags' in usage
+
+    benchmarks = args.benchmarks or sorted(
+        os.path.basename(d.rstrip('/'))
+        for d in glob.glob(os.path.join(EMBENCH_DIR, 'src', '*/')))
+
+    # relative results, as embench reports them
+    gp['absolute'] = False
+    cycles, speedups = {}, {}
+    print(f'{"benchmark":16} {"base cycles":>22} {"sr cycles":>22} '
+          f'{"base instructions":>22} {"sr instructions":>22} {"speedup":>8}')
+    with tempfile.TemporaryDirectory() as tmp:
+        # the harness is the same for all, and built by the host compiler
+        args.harness = os.path.join(tmp, 'harness.o')
+        subprocess.run([args.cc, '-c', '-O2',
+                        f'-I{os.path.join(EMBENCH_DIR, "support")}',
+                        '-o', args.harness, HARNESS], check=True)
+        for bench in benchmarks:
+            stats = {}
+            for variant in PASSES:
+                binary = build(args, bench, variant,
+                               os.path.join(tmp, bench))
+                c, i = measure(args, binary)
+                stats[variant] = summary(c), summary(i)
+            base, sr = stats['base'][0], stats['sr'][0]
+            cycles[bench] = sr[0]
+            speedups[bench] = base[0] / sr[0] if sr[0] else 0
+            print(f'{bench:16} {show(base)} {show(sr)} '
+                  f'{show(stats["base"][1])} {show(stats["sr"][1])} '
+                  f'{speedups[bench]:8.3f}')
+
+    geomean, count = compute_geomean(benchmarks, cycles, speedups)
+    geosd = compute_geosd(benchmarks, cycles, speedups, geomean, count)
+    print(f'geometric mean speedup {geomean:.3f} (geometric sd {geosd:.3f}) '
+          f'over {count:.0f} benchmarks')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,40 @@
+#!/usr/bin/env python3
+# print the loop profile rtlib.c writes, hottest loops first; the loop ids
+# are in the "instrumented loop as <id>" remarks of the sr pass
+# usage: srprof.py [sr.prof]
+
+import struct
+import sys
+
+HEADER = struct.Struct('=4sIII')
+RECORD = struct.Struct('=IIQQQqq')
+HAS_STRIDE = 1
+
+
+def main():
+    path = sys.argv[1] if len(sys.argv) > 1 else 'sr.prof'
+    with open(path, 'rb') as f:
+        data = f.read()
+    magic, version, loops, _ = HEADER.unpack_from(data, 0)
+    if magic != b'SRPF' or version != 1:
+        sys.exit(f'{path}: not a version 1 sr profile')
+    records = [RECORD.unpack_from(data, HEADER.size + i * RECORD.size)
+               for i in range(loops)]
+    records.sort(key=lambda r: r[3], reverse=True)
+
+    print(f'{"loop":>8} {"entries":>12} {"iterations":>14} {"avg trip":>10} '
+          f'{"max trip":>10}  stride')
+    for id, flags, entries, iterations, max_trip, lo, hi in records:
+        avg = iterations / entries if entries else 0
+        if not flags & HAS_STRIDE:
+            stride = '-'
+        elif lo == hi:
+            stride = str(lo)
+        else:
+            stride = f'{lo}..{hi}'
+        print(f'{id:8X} {entries:12} {iterations:14} {avg:10.1f} '
+              f'{max_trip:10}  {stride}')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,42 @@
+#!/bin/sh
+# count the loops the loop vectorizer widens in every embench benchmark at
+# -O2, without and with the sr pass, and fail if sr costs any of them
+# usage: vectorize_check.sh [build dir] [extra opt flags for sr]
+# e.g.   vectorize_check.sh build -sr-vectorizer-friendly
+
+BUILD=${1:-build}
+[ $# -gt 0 ] && shift
+PLUGIN=$BUILD/skeleton/libSkeletonPass.so
+EMBENCH_DIR=${EMBENCH_DIR:-embench-iot}
+TMP=$(mktemp -d)
+trap 'rm -rf $TMP' EXIT
+
+# the number of "vectorized loop" remarks opt prints for $1
+count() {
+  f=$1; shift
+  opt "$@" -passes='default<O2>' -pass-remarks=loop-vectorize \
+    -disable-output $f 2>&1 | grep -c "vectorized loop"
+}
+
+status=0
+printf "%-16s %8s %8s\n" benchmark baseline sr
+for dir in $EMBENCH_DIR/src/*/; do
+  name=$(basename $dir)
+  base=0
+  sr=0
+  for c in $dir*.c; do
+    ll=$TMP/$name-$(basename $c .c).ll
+    # unoptimized but not optnone, so opt runs the whole -O2 pipeline
+    clang -S -emit-llvm -O2 -Xclang -disable-llvm-passes $c -o $ll \
+      -I$dir -I$EMBENCH_DIR/support -DCPU_MHZ=1000 || exit 1
+    base=$((base + $(count $ll)))
+    # the plugin runs sr at the end of the loop optimizer, before the
+    # vectorizer; -load as well makes its options available
+    sr=$((sr + $(count $ll -load $PLUGIN -load-pass-plugin $PLUGIN "$@")))
+  done
+  printf "%-16s %8d %8d\n" $name $base $sr
+  if [ $sr -lt $base ]; then
+    status=1
+  fi
+done
+exit $status